@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "core/bitmap.h"
 #include "core/file.h"
+#include "core/memStream.h"
 
 Bitmap::Bitmap() : internalFormat(RGBA),
     pBits(NULL),
@@ -80,4 +81,31 @@ bool Bitmap::read(File &file)
     }
     
     return true;
+}
+
+bool Bitmap::read(MemStream &stream)
+{
+    U32 format;
+    
+    stream.read(&format);
+    stream.read(&width);
+    stream.read(&height);
+    
+    if (!stream.isOk() || format != RGBA || width == 0 || height == 0 ||
+        U64(width) * height * 4 > stream.getRemaining())
+    {
+        stream.fail();
+        return false;
+    }
+    
+    allocateBitmap(width, height, (BitmapFormat) format);
+    return stream.read(byteSize, pBits);
+}
+
+void Bitmap::write(MemStream &stream) const
+{
+    stream.write((U32) internalFormat);
+    stream.write(width);
+    stream.write(height);
+    stream.write(byteSize, pBits);
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #endif
 
 class File;
+class MemStream;
 
 class Bitmap
 {
@@ -19,6 +20,9 @@ public:
     ~Bitmap();
     
     bool read(File &file);
+    // Pixels stay in the internal format
+    bool read(MemStream &stream);
+    void write(MemStream &stream) const;
     
 private:
     void allocateBitmap(const U32 in_width, const U32 in_height, const BitmapFormat in_format);
@@ -5,8 +5,14 @@
 #include "platform/platform.h"
 #endif
 
+#ifndef _PACKET_H_
+#include "math/packet.h"
+#endif
+
 #define INV255 1.0f/255.0f
 
+// The four channels are contiguous so the operators work on all of them at
+// once with a PacketF32
 class ColorF
 {
 public:
@@ -28,6 +34,10 @@ public:
     ColorF operator*(F32 mul) const;
     
     void clamp();
+    
+private:
+    ColorF(const PacketF32 &p) { p.store(&red); }
+    PacketF32 get() const { return PacketF32(&red); }
 };
 
 // Inlines
@@ -55,60 +65,30 @@ inline void ColorF::set(const F32 r, const F32 g, const F32 b, const F32 a)
 
 inline ColorF& ColorF::operator+=(const ColorF& add)
 {
-    red += add.red;
-    green += add.green;
-    blue += add.blue;
-    alpha += add.alpha;
+    (get() + add.get()).store(&red);
     return *this;
 }
 
 inline ColorF ColorF::operator+(const ColorF& add) const
 {
-    return ColorF(red + add.red,
-                  green + add.green,
-                  blue  + add.blue,
-                  alpha + add.alpha);
+    return ColorF(get() + add.get());
 }
 
+// Alpha is left as is
 inline ColorF& ColorF::operator*=(F32 mul)
 {
-    red *= mul;
-    green *= mul;
-    blue *= mul;
-    //alpha *= mul;
+    (get() * PacketF32(mul, mul, mul, 1.0f)).store(&red);
     return *this;
 }
 
 inline ColorF ColorF::operator*(F32 mul) const
 {
-    return ColorF(red * mul,
-                  green * mul,
-                  blue  * mul,
-                  alpha);
-    
+    return ColorF(get() * PacketF32(mul, mul, mul, 1.0f));
 }
 
 inline void ColorF::clamp()
 {
-    if (red > 1.0f)
-        red = 1.0f;
-    else if (red < 0.0f)
-        red = 0.0f;
-    
-    if (green > 1.0f)
-        green = 1.0f;
-    else if (green < 0.0f)
-        green = 0.0f;
-    
-    if (blue > 1.0f)
-        blue = 1.0f;
-    else if (blue < 0.0f)
-        blue = 0.0f;
-    
-    if (alpha > 1.0f)
-        alpha = 1.0f;
-    else if (alpha < 0.0f)
-        alpha = 0.0f;
+    minimum(maximum(get(), PacketF32(0.0f)), PacketF32(1.0f)).store(&red);
 }
 
 #endif
\ No newline at end of file
@@ -45,6 +45,9 @@ public:
     
     Status write(U32 size, const void *src, U32 *bytesWritten = NULL);
     
+    // Last write time and size of a file, false if it cannot be found
+    static bool getInfo(const char *filename, U64 &modifiedTime, U64 &size);
+    
 private:
     void *mHandle;
     Status mStatus;
@@ -52,4 +55,24 @@ private:
     bool mCanWrite;
 };
 
+// Read-only view of a whole file mapped in memory
+class MappedFile
+{
+public:
+    MappedFile();
+    virtual ~MappedFile();
+    
+    bool open(const char *filename);
+    void close();
+    
+    const U8* getData() const { return mData; }
+    U32 getSize() const { return mSize; }
+    
+private:
+    void *mHandle;
+    void *mMapping;
+    const U8 *mData;
+    U32 mSize;
+};
+
 #endif
\ No newline at end of file
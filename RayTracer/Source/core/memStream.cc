@@ -0,0 +1,54 @@
+#include <string.h>
+#include "core/memStream.h"
+
+MemStream::MemStream() : mData(NULL), mSize(0), mPosition(0), mOk(true)
+{
+}
+
+MemStream::MemStream(const void *data, U32 size) : mData((const U8 *) data), mSize(size), mPosition(0), mOk(true)
+{
+}
+
+MemStream::~MemStream()
+{
+}
+
+bool MemStream::read(U32 size, void *dst)
+{
+    if (!mOk || size > mSize - mPosition)
+        return mOk = false;
+    
+    memcpy(dst, mData + mPosition, size);
+    mPosition += size;
+    return true;
+}
+
+bool MemStream::write(U32 size, const void *src)
+{
+    if (size == 0)
+        return true;
+    
+    mBuffer.insert(mBuffer.end(), (const U8 *) src, (const U8 *) src + size);
+    mData = &mBuffer[0];
+    mSize = (U32) mBuffer.size();
+    mPosition = mSize;
+    return true;
+}
+
+bool MemStream::readString(std::string &string)
+{
+    U32 length;
+    
+    if (!read(&length) || length > mSize - mPosition)
+        return mOk = false;
+    
+    string.assign((const char *) mData + mPosition, length);
+    mPosition += length;
+    return true;
+}
+
+bool MemStream::writeString(const std::string &string)
+{
+    write((U32) string.length());
+    return write((U32) string.length(), string.data());
+}
\ No newline at end of file
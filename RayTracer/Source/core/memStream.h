@@ -0,0 +1,47 @@
+#ifndef _MEMSTREAM_H_
+#define _MEMSTREAM_H_
+
+#include <string>
+#include <vector>
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+// Binary stream over memory. Writes append to an internal buffer, reads walk a
+// buffer owned by the caller, like a mapped file. Reading past the end leaves
+// the destination untouched and the stream in a failed state.
+class MemStream
+{
+public:
+    MemStream();
+    MemStream(const void *data, U32 size);
+    virtual ~MemStream();
+    
+    bool read(U32 size, void *dst);
+    bool write(U32 size, const void *src);
+    
+    // Plain data only
+    template <class T> bool read(T *value) { return read(sizeof(T), value); }
+    template <class T> bool write(const T &value) { return write(sizeof(T), &value); }
+    
+    bool readString(std::string &string);
+    bool writeString(const std::string &string);
+    
+    bool isOk() const { return mOk; }
+    // For readers that find data they can't use
+    void fail() { mOk = false; }
+    const U8* getData() const { return mData; }
+    U32 getSize() const { return mSize; }
+    U32 getPosition() const { return mPosition; }
+    U32 getRemaining() const { return mSize - mPosition; }
+    
+private:
+    std::vector<U8> mBuffer;
+    const U8 *mData;
+    U32 mSize;
+    U32 mPosition;
+    bool mOk;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef _REFOBJECT_H_
+#define _REFOBJECT_H_
+
+#include <assert.h>
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+// Intrusive reference count for resources shared between objects. The count
+// starts at zero and the object deletes itself when the last reference is
+// released. References are not atomic, take them while loading.
+class RefObject
+{
+public:
+    RefObject() : mRefCount(0) {}
+    virtual ~RefObject() {}
+    
+    void addRef() { mRefCount++; }
+    void release();
+    U32 getRefCount() const { return mRefCount; }
+    
+private:
+    U32 mRefCount;
+};
+
+// Inlines
+
+inline void RefObject::release()
+{
+    assert(mRefCount > 0);
+    if (--mRefCount == 0)
+        delete this;
+}
+
+// Points ref to object, taking a reference on it and releasing the old one
+template <class T>
+inline void setRef(T *&ref, T *object)
+{
+    if (object)
+        object->addRef();
+    if (ref)
+        ref->release();
+    ref = object;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef _THREAD_H_
+#define _THREAD_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+class Thread
+{
+public:
+    typedef void (*Function)(void *arg);
+    
+public:
+    Thread(Function function, void *arg);
+    virtual ~Thread();
+    
+    bool start();
+    
+    // Waits for the thread function to return
+    void join();
+    
+    // Runs the thread function, called on the new thread
+    void run();
+    
+    static U32 getProcessorCount();
+    
+private:
+    Function mFunction;
+    void *mArg;
+    void *mHandle;
+};
+
+class Mutex
+{
+public:
+    Mutex();
+    virtual ~Mutex();
+    
+    void lock();
+    void unlock();
+    
+private:
+    void *mHandle;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,529 @@
+#include <assert.h>
+#include "math/math.h"
+#include "engine/rayTracer.h"
+
+#ifndef _THREAD_H_
+#include "core/thread.h"
+#endif
+
+#ifndef _TILEPOOL_H_
+#include "engine/tilePool.h"
+#endif
+
+#define MAX_DEPTH (8)
+#define MIN_WEIGHT (1.0f / 255.0f)
+#define TILE_SIZE (16)
+#define MAX_SAMPLES (16)
+#define CONTRAST (0.1f)
+
+RenderSettings::RenderSettings() :
+    hRes(640),
+    vRes(480),
+    wMin(-6.0, -4.0, 0.0),
+    wMax(6.0, 4.0, 0.0),
+    threadCount(0),
+    tileSize(TILE_SIZE),
+    maxDepth(MAX_DEPTH),
+    minWeight(MIN_WEIGHT),
+    russianRoulette(false),
+    packets(true),
+    maxSamples(MAX_SAMPLES),
+    contrast(CONTRAST),
+    background(0.05f, 0.05f, 0.05f)
+{
+}
+
+RayTracer::RayTracer() : mFrameBuffer(NULL), mFrameBufferSize(0)
+{
+}
+
+RayTracer::~RayTracer()
+{
+    if (mFrameBuffer)
+        delete[] mFrameBuffer;
+}
+
+ColorF RayTracer::shade(const SceneObject *obj, const Ray &ray, const Point3D &intersection, const Point3D &normal, const PointUV &uv, const F64 refractionIndex, const S32 depth, const F32 weight) const
+{
+    const PointLight *light;
+    const Material &m = obj->getMaterial();
+    // L is the vector from the light to the intersection point
+    // N is the normal at the intersection point
+    // R is the light rebound vector
+    // V is the vector from the eye to the intersection point
+    Point3D L, N, R, V;
+    // ip is the intersection point
+    Point3D ip = intersection;
+    // Ip is the light intensity
+    // fatt is the light attenuation factor
+    // Temporal variables to store some dot product results
+    F32 Ip, fatt, dotNL, dotRV;
+    
+    // Lighting
+    ColorF I(0.0, 0.0, 0.0);
+    ColorF Od = m.diffuseColor;
+    ColorF Os = m.specularColor;
+    F32 kd = m.diffusseCoefficient;         // kd is the diffuse-reflection coefficient2
+    F32 ks = m.shininess;                       // ks is the specular-reflection coefficient
+    F32 n = m.specularReflectionExponent;  // n is the specular-reflection exponent
+    F32 O1 = m.diffusiveness;
+    F32 O2 = m.reflectiveness;
+    F32 O3 = m.transparency;
+    F64 d;                                          // Ligh vector magnitude
+    //F64 distance;
+    
+    V = ray.getDirection() * -1;
+    N = normal;
+    
+    
+    const Texture *texture = obj->getTexture();
+    const BumpMap *bumpMap = obj->getBumpMap();
+    const NormalMap *normalMap = obj->getNormalMap();
+    //const OpacityMap *opacityMap = obj->getOpacityMap();
+    
+    if (texture || bumpMap || normalMap/* || opacityMap*/)
+    {
+        //PointUV uv = obj->getUV(ip, N);
+        
+        if (texture)
+        {
+            U32 i = U32(texture->hTileSize * uv.u) % texture->bitmap.width;
+            U32 j = U32(texture->vTileSize * uv.v) % texture->bitmap.height;
+            texture->getTexel(i, j, Od);
+            
+            if (Od.alpha < 1.0)
+            {
+                O1 = Od.alpha;
+                O3 = 1.0f - Od.alpha;
+                Od.alpha = 1.0f;
+            }
+        }
+        
+        if (bumpMap)
+        {
+            U32 i = U32(bumpMap->hTileSize * uv.u) % bumpMap->width;
+            U32 j = U32(bumpMap->vTileSize * uv.v) % bumpMap->height;
+            F32 h = bumpMap->getHeight(i, j);
+            
+            ip = ip + N * h;
+            obj->perturbNormal(N, i, j);
+            //F32 h = bumpMap->getHeight(i, j);;
+            //Od.set(h / 255, h / 255, h / 255);
+        }
+        
+        if (normalMap)
+        {
+            U32 i = U32(normalMap->hTileSize * uv.u) % normalMap->width;
+            U32 j = U32(normalMap->vTileSize * uv.v) % normalMap->height;
+            
+            N = normalMap->getNormal(i, j);
+        }
+    }
+    
+    // The diffuse and specular lighting, with its shadow rays, is skipped when
+    // it can't be seen in the pixel. Not with the roulette, its survivors come
+    // in at minWeight and their scaled up color has to keep all of the light
+    if (weight * O1 >= mSettings.minWeight || mSettings.russianRoulette)
+    {
+        const std::vector<U32> &lights = mScene.findLights(ip);
+        
+        for (U32 k = 0; k < lights.size(); ++k)
+        {
+            light = mScene.getLight(lights[k]);
+            Ip = light->getIntensity();
+            L = light->getLocation() - ip;
+            d = L.length();
+            
+            // Too far to add anything, no shadow ray
+            if (d > mScene.getLightRange(lights[k]))
+                continue;
+            
+            L.normalize();
+            
+            F32 S = mScene.occlusion(Ray(ip, L), d);
+            
+            if (S > EPSILON)
+            {
+                fatt = light->getAttenuationFactor(F32(d));
+                
+                // Diffusse reflection
+                dotNL = max(F32(dot(N, L)), 0.0f);
+                
+                // Specular reflection
+                R = N * 2 * dot(N, L) - L;
+                dotRV = max(F32(dot(R, V)), 0.0f);
+                
+                // Add light contribution
+                I += (Od * kd * dotNL +  Os * ks * pow(dotRV, n)) * S * fatt * Ip;
+            }
+        }
+    }
+    
+    F32 Ia = m.ambientIntensity;
+    I += Od * Ia;
+    
+    
+    
+    I *= O1;
+    //I = Od;
+    
+    if (depth <= mSettings.maxDepth)
+    {
+        F32 scale;
+        
+        if (O2 >  EPSILON)
+        {
+            F64 distance = F64_MAX;
+            R = N * 2 * dot(N, V) - V;
+            Ray reflected(ip, R);
+            
+            if (isTraced(reflected, weight * O2, scale))
+            {
+                ColorF color = trace(reflected, distance, refractionIndex, depth + 1, weight * O2 * scale);
+                I += color * (O2 * scale);
+            }
+        }
+        
+        if (O3 > EPSILON)
+        {
+            F64 u1 = refractionIndex;
+            F64 u2 = m.refractionIndex;
+            F64 u = u1 / u2;
+            F64 squaredU = u * u;
+            F64 dotNV = dot(N, V);
+            F64 radical = 1.0 - squaredU * (1.0 - dotNV * dotNV);
+            if (radical > EPSILON)
+            {
+                Point3D T = N * (u * dotNV - sqrt(radical)) - V * u;
+                F64 distance = F64_MAX;
+                Ray refracted(ip, T);
+                
+                if (isTraced(refracted, weight * O3, scale))
+                {
+                    ColorF color = trace(refracted, distance, u2, depth + 1, weight * O3 * scale);
+                    I += color * (O3 * scale);
+                }
+            }
+        }
+    }
+    
+    I.clamp();
+    return I;
+}
+
+// Hashes the ray into [0, 1). The roulette needs no random state shared by the
+// threads this way, and renders can be repeated
+static F32 hashRay(const Ray &ray)
+{
+    const U8 *bytes = (const U8 *) &ray.getDirection();
+    U32 hash = 2166136261u;
+    
+    for (U32 i = 0; i < sizeof(Point3D); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return (hash >> 8) * (1.0f / 16777216.0f);
+}
+
+bool RayTracer::isTraced(const Ray &ray, F32 weight, F32 &scale) const
+{
+    scale = 1.0f;
+    
+    if (weight >= mSettings.minWeight)
+        return true;
+    
+    if (!mSettings.russianRoulette || weight <= 0.0f)
+        return false;
+    
+    // Survivors make up for the rays cut off
+    F32 survival = weight / mSettings.minWeight;
+    
+    if (hashRay(ray) >= survival)
+        return false;
+    
+    scale = 1.0f / survival;
+    return true;
+}
+
+ColorF RayTracer::trace(const Ray &ray, F64 &distance, F64 refractionIndex, S32 depth, F32 weight) const
+{
+    Point3D intersection;
+    Point3D normal;
+    PointUV uv;
+    const SceneObject *intersectedObj = mScene.findClosestIntersection(ray, intersection, normal, uv, distance);
+    
+    if (intersectedObj)
+    {
+        return shade(intersectedObj, ray, intersection, normal, uv, refractionIndex, depth, weight);
+    }
+    else
+    {
+        return mSettings.background;
+    }
+}
+
+ColorF RayTracer::tracePrimary(const Ray &ray, const SceneObject *&obj) const
+{
+    Point3D intersection;
+    Point3D normal;
+    PointUV uv;
+    F64 distance = F64_MAX;
+    
+    obj = mScene.findClosestIntersection(ray, intersection, normal, uv, distance);
+    
+    if (obj)
+        return shade(obj, ray, intersection, normal, uv, 1.0f, 1, 1.0f);
+    else
+        return mSettings.background;
+}
+
+class RenderWorker
+{
+public:
+    RayTracer *tracer;
+    TilePool *pool;
+    Point3D eye;
+    U32 index;
+    bool refine;
+};
+
+Ray RayTracer::getPrimaryRay(const Point3D &eye, F64 x, F64 y) const
+{
+    // Get the point in the projection plane, pixel (i, j) spans from (i, j) to
+    // (i + 1, j + 1)
+    Point3D w;
+    w.x = mSettings.wMin.x + x * (mSettings.wMax.x - mSettings.wMin.x) / mSettings.hRes;
+    w.y = mSettings.wMin.y + y * (mSettings.wMax.y - mSettings.wMin.y) / mSettings.vRes;
+    w.z = 0.0;
+    
+    Point3D direction = w - eye;
+    direction.normalize();
+    return Ray(eye, direction);
+}
+
+void RayTracer::setPixel(U32 i, U32 j, const ColorF &color)
+{
+    U32 pos = 4 * (mSettings.hRes * j + i);
+    mFrameBuffer[pos] = 255;
+    mFrameBuffer[pos + 1] = U8(255 * color.red);
+    mFrameBuffer[pos + 2] = U8(255 * color.green);
+    mFrameBuffer[pos + 3] = U8(255 * color.blue);
+}
+
+void RayTracer::tracePacket(const RayPacket &packet, ColorF *colors, const SceneObject **objects) const
+{
+    F64 distance[RayPacket::SIZE];
+    U32 primitives[RayPacket::SIZE];
+    
+    for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+        distance[lane] = F64_MAX;
+    
+    mScene.findClosestIntersections(packet, objects, primitives, distance);
+    
+    // Shading diverges right away, every ray goes on alone
+    for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+    {
+        if (!(packet.getMask() & (1 << lane)))
+            continue;
+        
+        if (objects[lane])
+        {
+            Ray ray = packet.getRay(lane);
+            Point3D intersection;
+            Point3D normal;
+            PointUV uv;
+            
+            mScene.getSurface(objects[lane], primitives[lane], ray, distance[lane], intersection, normal, uv);
+            colors[lane] = shade(objects[lane], ray, intersection, normal, uv, 1.0f, 1, 1.0f);
+        }
+        else
+            colors[lane] = mSettings.background;
+    }
+}
+
+void RayTracer::renderTile(const Point3D &eye, const Tile &tile)
+{
+    // Primary rays go in 2x2 pixel packets
+    for (U32 j = tile.top; j < tile.bottom; j += 2)
+    {
+        for (U32 i = tile.left; i < tile.right; i += 2)
+        {
+            RayPacket packet;
+            ColorF colors[RayPacket::SIZE];
+            const SceneObject *objects[RayPacket::SIZE];
+            
+            for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+            {
+                U32 x = i + (lane & 1);
+                U32 y = j + (lane >> 1);
+                
+                if (x < tile.right && y < tile.bottom)
+                    packet.setRay(lane, getPrimaryRay(eye, x + 0.5, y + 0.5));
+            }
+            
+            if (mSettings.packets)
+                tracePacket(packet, colors, objects);
+            else
+            {
+                for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+                {
+                    if (packet.getMask() & (1 << lane))
+                        colors[lane] = tracePrimary(packet.getRay(lane), objects[lane]);
+                }
+            }
+            
+            for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+            {
+                if (packet.getMask() & (1 << lane))
+                {
+                    U32 x = i + (lane & 1);
+                    U32 y = j + (lane >> 1);
+                    U32 pos = mSettings.hRes * y + x;
+                    
+                    mSamples[pos] = colors[lane];
+                    mSampleObjects[pos] = objects[lane];
+                    setPixel(x, y, colors[lane]);
+                }
+            }
+        }
+    }
+}
+
+bool RayTracer::isEdge(const ColorF &a, const SceneObject *objA, const ColorF &b, const SceneObject *objB) const
+{
+    return objA != objB ||
+           fabs(a.red - b.red) > mSettings.contrast ||
+           fabs(a.green - b.green) > mSettings.contrast ||
+           fabs(a.blue - b.blue) > mSettings.contrast;
+}
+
+ColorF RayTracer::samplePixel(const Point3D &eye, F64 x, F64 y, F64 size, const ColorF &color, const SceneObject *obj, U32 &budget) const
+{
+    // color was sampled at the center of the square (x, y, size). The square
+    // is split in four and the center of each quarter sampled, the quarters
+    // that still differ from color are split again while the budget lasts
+    if (budget < 4)
+        return color;
+    
+    budget -= 4;
+    
+    F64 half = size / 2;
+    ColorF colors[4];
+    const SceneObject *objects[4];
+    
+    for (U32 k = 0; k < 4; k++)
+        colors[k] = tracePrimary(getPrimaryRay(eye, x + (k & 1) * half + half / 2, y + (k >> 1) * half + half / 2), objects[k]);
+    
+    ColorF sum(0.0f, 0.0f, 0.0f, 0.0f);
+    
+    for (U32 k = 0; k < 4; k++)
+    {
+        if (isEdge(colors[k], objects[k], color, obj))
+            sum += samplePixel(eye, x + (k & 1) * half, y + (k >> 1) * half, half, colors[k], objects[k], budget);
+        else
+            sum += colors[k];
+    }
+    return sum * 0.25f;
+}
+
+void RayTracer::refineTile(const Point3D &eye, const Tile &tile)
+{
+    // Only the pixels that differ from a neighbour get more samples. The
+    // neighbours are read from the first samples, which no tile writes anymore
+    for (U32 j = tile.top; j < tile.bottom; j++)
+    {
+        for (U32 i = tile.left; i < tile.right; i++)
+        {
+            U32 pos = mSettings.hRes * j + i;
+            const ColorF &color = mSamples[pos];
+            const SceneObject *obj = mSampleObjects[pos];
+            
+            if ((i > 0 && isEdge(color, obj, mSamples[pos - 1], mSampleObjects[pos - 1])) ||
+                (i + 1 < mSettings.hRes && isEdge(color, obj, mSamples[pos + 1], mSampleObjects[pos + 1])) ||
+                (j > 0 && isEdge(color, obj, mSamples[pos - mSettings.hRes], mSampleObjects[pos - mSettings.hRes])) ||
+                (j + 1 < mSettings.vRes && isEdge(color, obj, mSamples[pos + mSettings.hRes], mSampleObjects[pos + mSettings.hRes])))
+            {
+                U32 budget = mSettings.maxSamples - 1;
+                setPixel(i, j, samplePixel(eye, i, j, 1.0, color, obj, budget));
+            }
+        }
+    }
+}
+
+void RayTracer::renderWorker(void *arg)
+{
+    RenderWorker *worker = (RenderWorker *) arg;
+    Tile tile;
+    
+    while (worker->pool->getTile(worker->index, tile))
+    {
+        if (worker->refine)
+            worker->tracer->refineTile(worker->eye, tile);
+        else
+            worker->tracer->renderTile(worker->eye, tile);
+    }
+}
+
+U32 RayTracer::getThreadCount() const
+{
+    return (mSettings.threadCount > 0)? mSettings.threadCount : Thread::getProcessorCount();
+}
+
+void RayTracer::runWorkers(bool refine)
+{
+    U32 count = getThreadCount();
+    TilePool pool(mSettings.hRes, mSettings.vRes, mSettings.tileSize, count);
+    std::vector<RenderWorker> workers(count);
+    std::vector<Thread*> threads;
+    
+    for (U32 k = 0; k < count; ++k)
+    {
+        workers[k].tracer = this;
+        workers[k].pool = &pool;
+        workers[k].eye = mScene.getViewpoint();
+        workers[k].index = k;
+        workers[k].refine = refine;
+    }
+    
+    // The calling thread works too
+    for (U32 k = 1; k < count; ++k)
+    {
+        Thread *thread = new Thread(renderWorker, &workers[k]);
+        if (thread->start())
+            threads.push_back(thread);
+        else
+            delete thread; // Its tiles get stolen by the others
+    }
+    renderWorker(&workers[0]);
+    
+    while (!threads.empty())
+    {
+        Thread *thread = threads.back();
+        threads.pop_back();
+        thread->join();
+        delete thread;
+    }
+}
+
+void RayTracer::render()
+{
+    U32 size = mSettings.hRes * mSettings.vRes * 4;
+    
+    if (size != mFrameBufferSize)
+    {
+        if (mFrameBuffer)
+            delete[] mFrameBuffer;
+        mFrameBuffer = new U8[size];
+        mFrameBufferSize = size;
+    }
+    mSamples.resize(mSettings.hRes * mSettings.vRes);
+    mSampleObjects.resize(mSettings.hRes * mSettings.vRes);
+    
+    // One sample per pixel first, anti-aliasing needs the samples of the
+    // neighbours from every tile
+    runWorkers(false);
+    
+    if (mSettings.maxSamples > 1)
+        runWorkers(true);
+}
\ No newline at end of file
@@ -1,6 +1,90 @@
 #ifndef _RAYTRACER_H_
 #define _RAYTRACER_H_
 
+#include <vector>
 
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+#ifndef _COLOR_H_
+#include "core/color.h"
+#endif
 
+#ifndef _SCENE_H_
+#include "scene/scene.h"
 #endif
+
+class Tile;
+
+class RenderSettings
+{
+public:
+    RenderSettings();
+    
+    U32 hRes;
+    U32 vRes;
+    Point3D wMin;           // Window on the projection plane
+    Point3D wMax;
+    U32 threadCount;        // Zero uses one thread per processor
+    U32 tileSize;
+    S32 maxDepth;
+    F32 minWeight;          // Secondary rays that add less than this to a pixel are cut off
+    bool russianRoulette;   // Trace some of those at random instead, scaled so the mean is kept.
+                            // The lighting of dim surfaces isn't skipped then either
+    bool packets;           // Trace primary rays in packets
+    U32 maxSamples;         // Samples per pixel cap for anti-aliasing, one disables it
+    F32 contrast;           // Channel difference between neighbours that gets a pixel refined
+    ColorF background;
+};
+
+// Owns a scene with its frame buffer and render settings. Each instance is
+// independent, so several scenes can be loaded and rendered at the same time.
+class RayTracer
+{
+public:
+    RayTracer();
+    virtual ~RayTracer();
+    
+    void load(const char *filename) { mScene.load(filename); }
+    void render();
+    
+    Scene& getScene() { return mScene; }
+    RenderSettings& getSettings() { return mSettings; }
+    U32 getThreadCount() const;
+    
+    // ARGB, one row after the other
+    const U8* getFrameBuffer() const { return mFrameBuffer; }
+    U32 getFrameBufferSize() const { return mFrameBufferSize; }
+    
+    // weight is the part of the pixel color that the ray makes up
+    ColorF trace(const Ray &ray, F64 &distance, F64 refractionIndex, S32 depth, F32 weight = 1.0f) const;
+    
+private:
+    ColorF shade(const SceneObject *obj, const Ray &ray, const Point3D &intersection, const Point3D &normal, const PointUV &uv, const F64 refractionIndex, const S32 depth, const F32 weight) const;
+    bool isTraced(const Ray &ray, F32 weight, F32 &scale) const;
+    ColorF tracePrimary(const Ray &ray, const SceneObject *&obj) const;
+    Ray getPrimaryRay(const Point3D &eye, F64 x, F64 y) const;
+    void tracePacket(const RayPacket &packet, ColorF *colors, const SceneObject **objects) const;
+    void setPixel(U32 i, U32 j, const ColorF &color);
+    void renderTile(const Point3D &eye, const Tile &tile);
+    
+    // Adaptive anti-aliasing, done once every pixel has its first sample
+    bool isEdge(const ColorF &a, const SceneObject *objA, const ColorF &b, const SceneObject *objB) const;
+    ColorF samplePixel(const Point3D &eye, F64 x, F64 y, F64 size, const ColorF &color, const SceneObject *obj, U32 &budget) const;
+    void refineTile(const Point3D &eye, const Tile &tile);
+    
+    void runWorkers(bool refine);
+    static void renderWorker(void *arg);
+    
+private:
+    Scene mScene;
+    RenderSettings mSettings;
+    U8 *mFrameBuffer;
+    U32 mFrameBufferSize;
+    // First sample and object of every pixel, kept for the anti-aliasing pass
+    std::vector<ColorF> mSamples;
+    std::vector<const SceneObject*> mSampleObjects;
+};
+
+#endif
\ No newline at end of file
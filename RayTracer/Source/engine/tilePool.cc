@@ -0,0 +1,80 @@
+#include <assert.h>
+#include "engine/tilePool.h"
+
+TilePool::TilePool(U32 width, U32 height, U32 tileSize, U32 workerCount)
+{
+    assert(tileSize > 0 && workerCount > 0);
+    U32 hTiles = (width + tileSize - 1) / tileSize;
+    U32 vTiles = (height + tileSize - 1) / tileSize;
+    U32 tileCount = hTiles * vTiles;
+    U32 runLength = (tileCount + workerCount - 1) / workerCount;
+    
+    for (U32 w = 0; w < workerCount; ++w)
+        mQueues.push_back(new Queue());
+    
+    // Rows of tiles are kept together so a worker walks the frame buffer in order
+    for (U32 k = 0; k < tileCount; ++k)
+    {
+        Tile tile;
+        tile.left = (k % hTiles) * tileSize;
+        tile.top = (k / hTiles) * tileSize;
+        tile.right = min(tile.left + tileSize, width);
+        tile.bottom = min(tile.top + tileSize, height);
+        mQueues[k / runLength]->tiles.push_back(tile);
+    }
+}
+
+TilePool::~TilePool()
+{
+    while (!mQueues.empty())
+    {
+        Queue *queue = mQueues.back();
+        mQueues.pop_back();
+        delete queue;
+    }
+}
+
+bool TilePool::getTile(U32 worker, Tile &tile)
+{
+    return pop(worker, tile) || steal(worker, tile);
+}
+
+bool TilePool::pop(U32 worker, Tile &tile)
+{
+    Queue *queue = mQueues[worker];
+    bool found = false;
+    
+    queue->mutex.lock();
+    if (!queue->tiles.empty())
+    {
+        tile = queue->tiles.front();
+        queue->tiles.pop_front();
+        found = true;
+    }
+    queue->mutex.unlock();
+    return found;
+}
+
+bool TilePool::steal(U32 worker, Tile &tile)
+{
+    U32 count = (U32) mQueues.size();
+    
+    for (U32 k = 1; k < count; ++k)
+    {
+        Queue *queue = mQueues[(worker + k) % count];
+        bool found = false;
+        
+        queue->mutex.lock();
+        if (!queue->tiles.empty())
+        {
+            tile = queue->tiles.back();
+            queue->tiles.pop_back();
+            found = true;
+        }
+        queue->mutex.unlock();
+        
+        if (found)
+            return true;
+    }
+    return false;
+}
\ No newline at end of file
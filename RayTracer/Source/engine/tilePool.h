@@ -0,0 +1,53 @@
+#ifndef _TILEPOOL_H_
+#define _TILEPOOL_H_
+
+#include <deque>
+#include <vector>
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+#ifndef _THREAD_H_
+#include "core/thread.h"
+#endif
+
+class Tile
+{
+public:
+    U32 left;
+    U32 top;
+    U32 right;      // Exclusive
+    U32 bottom;     // Exclusive
+};
+
+// Splits a frame in square tiles and deals them in contiguous runs to one queue
+// per worker. A worker takes tiles from the front of its own queue and, once it
+// runs dry, steals from the back of the others.
+class TilePool
+{
+public:
+    TilePool(U32 width, U32 height, U32 tileSize, U32 workerCount);
+    virtual ~TilePool();
+    
+    // Returns false when every tile has been handed out
+    bool getTile(U32 worker, Tile &tile);
+    
+    U32 getWorkerCount() const { return (U32) mQueues.size(); }
+    
+private:
+    class Queue
+    {
+    public:
+        Mutex mutex;
+        std::deque<Tile> tiles;
+    };
+    
+    bool pop(U32 worker, Tile &tile);
+    bool steal(U32 worker, Tile &tile);
+    
+private:
+    std::vector<Queue*> mQueues;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "math/math.h"
+
+// Shrinks the box to the bounds of its intersection with the half-space
+// dot(normal, p - anchor) <= 0, the side kept by a cut plane
+template <class T>
+void Box3DT<T>::clip(const Point3DT<T> &anchor, const Point3DT<T> &normal)
+{
+    if (isEmpty())
+        return;
+    
+    if (!isFinite())
+    {
+        // Only planes perpendicular to an axis can be applied to an open box
+        T *minP = &minExtents.x;
+        T *maxP = &maxExtents.x;
+        const T *n = &normal.x;
+        const T *a = &anchor.x;
+        
+        for (S32 i = 0; i < 3; ++i)
+        {
+            S32 j = (i + 1) % 3;
+            S32 k = (i + 2) % 3;
+            
+            if (!isZero(n[j]) || !isZero(n[k]) || isZero(n[i]))
+                continue;
+            if (n[i] > 0.0)
+                maxP[i] = min(maxP[i], a[i]);
+            else
+                minP[i] = max(minP[i], a[i]);
+        }
+        return;
+    }
+    
+    Point3DT<T> corners[8];
+    T d[8];
+    Box3DT box;
+    
+    for (S32 c = 0; c < 8; ++c)
+    {
+        corners[c].set((c & 1)? maxExtents.x : minExtents.x,
+                       (c & 2)? maxExtents.y : minExtents.y,
+                       (c & 4)? maxExtents.z : minExtents.z);
+        d[c] = dot(normal, corners[c] - anchor);
+        if (d[c] <= 0.0)
+            box.extend(corners[c]);
+    }
+    
+    // Add the points where the plane crosses the box edges
+    for (S32 c = 0; c < 8; ++c)
+    {
+        for (S32 axis = 0; axis < 3; ++axis)
+        {
+            S32 other = c | (1 << axis);
+            
+            if (other == c || (d[c] <= 0.0) == (d[other] <= 0.0))
+                continue;
+            T t = d[c] / (d[c] - d[other]);
+            box.extend(corners[c] + (corners[other] - corners[c]) * t);
+        }
+    }
+    *this = box;
+}
+
+template class Box3DT<F32>;
+template class Box3DT<F64>;
\ No newline at end of file
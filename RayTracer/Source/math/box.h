@@ -0,0 +1,245 @@
+#ifndef _BOX_H_
+#define _BOX_H_
+
+#ifndef _MATH_H_
+#include "math/math.h"
+#endif
+
+template <class T>
+class Box3DT
+{
+public:
+    Point3DT<T> minExtents;
+    Point3DT<T> maxExtents;
+    
+    Box3DT();
+    Box3DT(const Point3DT<T> &_minExtents, const Point3DT<T> &_maxExtents);
+    
+    void empty();
+    void infinite();
+    bool isEmpty() const;
+    bool isFinite() const;
+    
+    void extend(const Point3DT<T> &point);
+    void extend(const Box3DT &box);
+    void extendDisk(const Point3DT<T> &center, const Point3DT<T> &normal, T radius);
+    void clip(const Point3DT<T> &anchor, const Point3DT<T> &normal);
+    
+    Point3DT<T> getCenter() const;
+    T getSurfaceArea() const;
+    S32 getLongestAxis() const;
+    
+    // Slab test. invDirection holds the reciprocal of each ray direction component
+    bool intersect(const Point3DT<T> &origin, const Point3DT<T> &invDirection, F64 maxDistance, F64 &nearDistance) const;
+    // Same test for every lane of a packet, returns the lanes that hit
+    U32 intersect(const PacketF64 *origin, const PacketF64 *invDirection, const PacketF64 &maxDistance, PacketF64 &nearDistance) const;
+    
+private:
+    // Largest finite T, the extents of empty and infinite boxes
+    static T getLimit();
+    // Widens the far distance of the slab test by its worst rounding error, so
+    // rays through an edge or a vertex of the box aren't lost
+    static T getFarScale();
+};
+
+// Instantiated for F32 and F64 in box.cc
+typedef Box3DT<Real> Box3D;
+
+// Inlines
+
+// Restricts the interval [lo, hi] to the values of s where a * s <= b
+inline void clipInterval(F64 a, F64 b, F64 &lo, F64 &hi)
+{
+    if (a > EPSILON)
+    {
+        if (b / a < hi)
+            hi = b / a;
+    }
+    else if (a < -EPSILON)
+    {
+        if (b / a > lo)
+            lo = b / a;
+    }
+    else if (b < 0.0)
+    {
+        lo = 1.0;
+        hi = 0.0;
+    }
+}
+
+template <class T>
+inline Box3DT<T>::Box3DT()
+{
+    empty();
+}
+
+template <class T>
+inline Box3DT<T>::Box3DT(const Point3DT<T> &_minExtents, const Point3DT<T> &_maxExtents) : minExtents(_minExtents), maxExtents(_maxExtents)
+{}
+
+template <class T>
+inline void Box3DT<T>::empty()
+{
+    minExtents.set(getLimit(), getLimit(), getLimit());
+    maxExtents.set(-getLimit(), -getLimit(), -getLimit());
+}
+
+template <class T>
+inline void Box3DT<T>::infinite()
+{
+    minExtents.set(-getLimit(), -getLimit(), -getLimit());
+    maxExtents.set(getLimit(), getLimit(), getLimit());
+}
+
+template <class T>
+inline bool Box3DT<T>::isEmpty() const
+{
+    return minExtents.x > maxExtents.x || minExtents.y > maxExtents.y || minExtents.z > maxExtents.z;
+}
+
+template <class T>
+inline bool Box3DT<T>::isFinite() const
+{
+    return minExtents.x > -getLimit() && minExtents.y > -getLimit() && minExtents.z > -getLimit() &&
+    maxExtents.x < getLimit() && maxExtents.y < getLimit() && maxExtents.z < getLimit();
+}
+
+template <class T>
+inline void Box3DT<T>::extend(const Point3DT<T> &point)
+{
+    if (point.x < minExtents.x) minExtents.x = point.x;
+    if (point.y < minExtents.y) minExtents.y = point.y;
+    if (point.z < minExtents.z) minExtents.z = point.z;
+    if (point.x > maxExtents.x) maxExtents.x = point.x;
+    if (point.y > maxExtents.y) maxExtents.y = point.y;
+    if (point.z > maxExtents.z) maxExtents.z = point.z;
+}
+
+template <class T>
+inline void Box3DT<T>::extend(const Box3DT &box)
+{
+    extend(box.minExtents);
+    extend(box.maxExtents);
+}
+
+// Encloses the disk centered at center, perpendicular to the unit vector normal
+template <class T>
+inline void Box3DT<T>::extendDisk(const Point3DT<T> &center, const Point3DT<T> &normal, T radius)
+{
+    Point3DT<T> e(radius * sqrt(max(T(1.0) - normal.x * normal.x, T(0.0))),
+                  radius * sqrt(max(T(1.0) - normal.y * normal.y, T(0.0))),
+                  radius * sqrt(max(T(1.0) - normal.z * normal.z, T(0.0))));
+    extend(center - e);
+    extend(center + e);
+}
+
+template <class T>
+inline Point3DT<T> Box3DT<T>::getCenter() const
+{
+    return (minExtents + maxExtents) * 0.5;
+}
+
+template <class T>
+inline T Box3DT<T>::getSurfaceArea() const
+{
+    if (isEmpty())
+        return 0.0;
+    
+    Point3DT<T> d = maxExtents - minExtents;
+    return 2.0 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+template <class T>
+inline S32 Box3DT<T>::getLongestAxis() const
+{
+    Point3DT<T> d = maxExtents - minExtents;
+    
+    if (d.x >= d.y && d.x >= d.z)
+        return 0;
+    return (d.y >= d.z)? 1 : 2;
+}
+
+template <class T>
+inline bool Box3DT<T>::intersect(const Point3DT<T> &origin, const Point3DT<T> &invDirection, F64 maxDistance, F64 &nearDistance) const
+{
+    T t0 = (minExtents.x - origin.x) * invDirection.x;
+    T t1 = (maxExtents.x - origin.x) * invDirection.x;
+    T tNear = (t0 < t1)? t0 : t1;
+    T tFar = (t0 < t1)? t1 : t0;
+    
+    t0 = (minExtents.y - origin.y) * invDirection.y;
+    t1 = (maxExtents.y - origin.y) * invDirection.y;
+    if (t0 > t1) { T tmp = t0; t0 = t1; t1 = tmp; }
+    if (t0 > tNear) tNear = t0;
+    if (t1 < tFar) tFar = t1;
+    
+    t0 = (minExtents.z - origin.z) * invDirection.z;
+    t1 = (maxExtents.z - origin.z) * invDirection.z;
+    if (t0 > t1) { T tmp = t0; t0 = t1; t1 = tmp; }
+    if (t0 > tNear) tNear = t0;
+    if (t1 < tFar) tFar = t1;
+    
+    tFar *= getFarScale();
+    nearDistance = tNear;
+    return tNear <= tFar && tFar >= 0.0 && tNear <= maxDistance;
+}
+
+template <class T>
+inline U32 Box3DT<T>::intersect(const PacketF64 *origin, const PacketF64 *invDirection, const PacketF64 &maxDistance, PacketF64 &nearDistance) const
+{
+    const T *minE = &minExtents.x;
+    const T *maxE = &maxExtents.x;
+    PacketF64 tNear, tFar;
+    
+    // Picks the bounds the way the scalar test does, NaN lanes included
+    for (U32 axis = 0; axis < 3; axis++)
+    {
+        PacketF64 t0 = (PacketF64(minE[axis]) - origin[axis]) * invDirection[axis];
+        PacketF64 t1 = (PacketF64(maxE[axis]) - origin[axis]) * invDirection[axis];
+        
+        if (axis == 0)
+        {
+            PacketMask less = t0 < t1;
+            tNear = select(less, t0, t1);
+            tFar = select(less, t1, t0);
+            continue;
+        }
+        
+        PacketMask swap = t0 > t1;
+        PacketF64 lo = select(swap, t1, t0);
+        PacketF64 hi = select(swap, t0, t1);
+        tNear = select(lo > tNear, lo, tNear);
+        tFar = select(hi < tFar, hi, tFar);
+    }
+    
+    tFar = tFar * PacketF64(getFarScale());
+    nearDistance = tNear;
+    return ((tNear <= tFar) & (tFar >= PacketF64(0.0)) & (tNear <= maxDistance)).getBits();
+}
+
+// 1 + 2 * gamma(3), gamma(n) being n * u / (1 - n * u) for the unit roundoff u
+template <>
+inline F32 Box3DT<F32>::getFarScale()
+{
+    return 1.0f + 2 * 1.7881397e-7f;
+}
+
+template <>
+inline F64 Box3DT<F64>::getFarScale()
+{
+    return 1.0 + 2 * 3.3306690738754706e-16;
+}
+
+template <>
+inline F32 Box3DT<F32>::getLimit()
+{
+    return F32_MAX;
+}
+
+template <>
+inline F64 Box3DT<F64>::getLimit()
+{
+    return F64_MAX;
+}
+
+#endif
\ No newline at end of file
@@ -17,17 +17,38 @@
 #include "math/ray.h"
 #endif
 
+#ifndef _RAYPACKET_H_
+#include "math/rayPacket.h"
+#endif
+
 #ifdef PI
 #undef PI
 #endif
 
 #define PI (3.141592653589793238462643)
 #define PI2 (3.141592653589793238462643 * 2)
+
+// Absolute tolerance, in scene units, of the comparisons with zero and the
+// smallest distance a hit can be from the ray origin, which keeps secondary
+// rays off the surface they leave. It has to stay above the rounding error of
+// Real at the coordinates of the scene. F64 keeps about 16 digits so 1e-6 is
+// safe for any reasonable scene. F32 keeps about 7, intersection math loses a
+// few of them, and 1e-3 is the finest tolerance that holds for scenes that fit
+// in about +/-100 units. Larger single precision scenes will show acne
+#ifdef USE_F32_MATH
+#define EPSILON (0.001)
+#else
 #define EPSILON (0.000001)
+#endif
 //  #define EPSILON (0.00000000000000000000000000000001)
+#define F32_MAX (3.402823466e+38F)
 #define F64_MAX (1.7976931348623157e+308)
 #define F64_MIN (4.9e-324)
 
 #define isZero(x) (x >= -EPSILON && x <= EPSILON)
 
+#ifndef _BOX_H_
+#include "math/box.h"
+#endif
+
 #endif
\ No newline at end of file
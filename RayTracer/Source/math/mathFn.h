@@ -6,14 +6,16 @@
 #include "math/point.h"
 #endif
 
-inline void cross(const Point3D &v1, const Point3D &v2, Point3D *res)
+template <class T>
+inline void cross(const Point3DT<T> &v1, const Point3DT<T> &v2, Point3DT<T> *res)
 {
     res->x = (v1.y * v2.z) - (v1.z * v2.y);
     res->y = (v1.z * v2.x) - (v1.x * v2.z);
     res->z = (v1.x * v2.y) - (v1.y * v2.x);
 }
 
-inline F64 dot(const Point3D &p1, const Point3D &p2)
+template <class T>
+inline T dot(const Point3DT<T> &p1, const Point3DT<T> &p2)
 {
     return (p1.x * p2.x + p1.y * p2.y + p1.z * p2.z);
 }
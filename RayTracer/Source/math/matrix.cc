@@ -1,64 +1,71 @@
 #include "math/matrix.h"
+#include "math/packet.h"
 #include "math/point.h"
 
-inline void matD_x_point3D(const F64 *a, const F64 *p, F64 *res)
+// The products are done on four lanes at once, a column of the matrix for a
+// point and a row of b for a matrix. Every lane adds its terms in the same
+// order as the scalar expression
+
+template <class T>
+inline void matD_x_point3D(const T *a, const T *p, T *res)
 {
-    res[0]  = a[0]*p[0]  + a[1]*p[1]  + a[2]*p[2]   + a[3];
-    res[1]  = a[4]*p[0]  + a[5]*p[1]  + a[6]*p[2]   + a[7];
-    res[2]  = a[8]*p[0]  + a[9]*p[1]  + a[10]*p[2]  + a[11];
+    typedef typename PacketOf<T>::Type Packet;
+    T result[4];
+    
+    (Packet(a[0], a[4], a[8], a[12]) * Packet(p[0]) +
+     Packet(a[1], a[5], a[9], a[13]) * Packet(p[1]) +
+     Packet(a[2], a[6], a[10], a[14]) * Packet(p[2]) +
+     Packet(a[3], a[7], a[11], a[15])).store(result);
+    
+    res[0] = result[0];
+    res[1] = result[1];
+    res[2] = result[2];
 }
 
-inline void matD_x_vectorD(const F64 *m, const F64 *v, F64 *vresult)
+template <class T>
+inline void matD_x_vectorD(const T *m, const T *v, T *vresult)
 {
     vresult[0] = m[0]*v[0] + m[1]*v[1] + m[2]*v[2];
     vresult[1] = m[4]*v[0] + m[5]*v[1] + m[6]*v[2];
     vresult[2] = m[8]*v[0] + m[9]*v[1] + m[10]*v[2];
 }
 
-inline void matD_x_point4D(const F64 *a, const F64 *p, F64 *res)
+template <class T>
+inline void matD_x_point4D(const T *a, const T *p, T *res)
 {
-    res[0]  = a[0]*p[0]  + a[1]*p[1]  + a[2]*p[2]   + a[3]*p[3];
-    res[1]  = a[4]*p[0]  + a[5]*p[1]  + a[6]*p[2]   + a[7]*p[3];
-    res[2]  = a[8]*p[0]  + a[9]*p[1]  + a[10]*p[2]  + a[11]*p[3];
-    res[3]  = a[12]*p[0] + a[13]*p[1] + a[14]*p[2]  + a[15]*p[3];
+    typedef typename PacketOf<T>::Type Packet;
+    
+    (Packet(a[0], a[4], a[8], a[12]) * Packet(p[0]) +
+     Packet(a[1], a[5], a[9], a[13]) * Packet(p[1]) +
+     Packet(a[2], a[6], a[10], a[14]) * Packet(p[2]) +
+     Packet(a[3], a[7], a[11], a[15]) * Packet(p[3])).store(res);
 }
 
-inline void matD_x_matD(const F64 *a, const F64 *b, F64 *res)
+template <class T>
+inline void matD_x_matD(const T *a, const T *b, T *res)
 {
-    res[0]  = a[0]*b[0]  + a[1]*b[4]  + a[2]*b[8]   + a[3]*b[12];
-    res[1]  = a[0]*b[1]  + a[1]*b[5]  + a[2]*b[9]   + a[3]*b[13];
-    res[2]  = a[0]*b[2]  + a[1]*b[6]  + a[2]*b[10]  + a[3]*b[14];
-    res[3]  = a[0]*b[3]  + a[1]*b[7]  + a[2]*b[11]  + a[3]*b[15];
+    typedef typename PacketOf<T>::Type Packet;
+    Packet b0(b), b1(b + 4), b2(b + 8), b3(b + 12);
     
-    res[4]  = a[4]*b[0]  + a[5]*b[4]  + a[6]*b[8]   + a[7]*b[12];
-    res[5]  = a[4]*b[1]  + a[5]*b[5]  + a[6]*b[9]   + a[7]*b[13];
-    res[6]  = a[4]*b[2]  + a[5]*b[6]  + a[6]*b[10]  + a[7]*b[14];
-    res[7]  = a[4]*b[3]  + a[5]*b[7]  + a[6]*b[11]  + a[7]*b[15];
-    
-    res[8]  = a[8]*b[0]  + a[9]*b[4]  + a[10]*b[8]  + a[11]*b[12];
-    res[9]  = a[8]*b[1]  + a[9]*b[5]  + a[10]*b[9]  + a[11]*b[13];
-    res[10] = a[8]*b[2]  + a[9]*b[6]  + a[10]*b[10] + a[11]*b[14];
-    res[11] = a[8]*b[3]  + a[9]*b[7]  + a[10]*b[11] + a[11]*b[15];
-    
-    res[12] = a[12]*b[0] + a[13]*b[4] + a[14]*b[8]  + a[15]*b[12];
-    res[13] = a[12]*b[1] + a[13]*b[5] + a[14]*b[9]  + a[15]*b[13];
-    res[14] = a[12]*b[2] + a[13]*b[6] + a[14]*b[10] + a[15]*b[14];
-    res[15] = a[12]*b[3] + a[13]*b[7] + a[14]*b[11] + a[15]*b[15];
+    for (S32 i = 0; i < 16; i += 4)
+        (Packet(a[i]) * b0 + Packet(a[i + 1]) * b1 + Packet(a[i + 2]) * b2 + Packet(a[i + 3]) * b3).store(res + i);
 }
 
-inline F64 matD_determinant(const F64 *m)
+template <class T>
+inline T matD_determinant(const T *m)
 {
     return m[0] * (m[5] * m[10] - m[6] * m[9])  +
     m[4] * (m[2] * m[9]  - m[1] * m[10]) +
     m[8] * (m[1] * m[6]  - m[2] * m[5])  ;
 }
 
-inline void matD_inverse(F64 *m)
+template <class T>
+inline void matD_inverse(T *m)
 {
-    F64 det = matD_determinant(m);
+    T det = matD_determinant(m);
     
-    F64 invDet = 1.0f/det;
-    F64 temp[16];
+    T invDet = 1.0f/det;
+    T temp[16];
     
     temp[0] = (m[5] * m[10]- m[6] * m[9]) * invDet;
     temp[1] = (m[9] * m[2] - m[10]* m[1]) * invDet;
@@ -94,14 +101,16 @@ inline void matD_inverse(F64 *m)
     m[11]= temp[6];
 }
 
-inline void swap(F64 &a, F64 &b)
+template <class T>
+inline void swap(T &a, T &b)
 {
-    F64 temp = a;
+    T temp = a;
     a = b;
     b = temp;
 }
 
-inline void matD_transpose(F64 *m)
+template <class T>
+inline void matD_transpose(T *m)
 {
     swap(m[1], m[4]);
     swap(m[2], m[8]);
@@ -111,13 +120,15 @@ inline void matD_transpose(F64 *m)
     swap(m[11],m[14]);
 }
 
-MatrixD::MatrixD()
+template <class T>
+MatrixT<T>::MatrixT()
 {
     for (int i = 0; i < 16; ++i)
         mData[i] = 0.0;
 }
 
-bool MatrixD::isIdentity() const
+template <class T>
+bool MatrixT<T>::isIdentity() const
 {
     return
     mData[0]  == 1.0f &&
@@ -138,7 +149,8 @@ bool MatrixD::isIdentity() const
     mData[15] == 1.0f;
 }
 
-MatrixD& MatrixD::identity()
+template <class T>
+MatrixT<T>& MatrixT<T>::identity()
 {
     mData[0]  = 1.0f;
     mData[1]  = 0.0f;
@@ -159,7 +171,8 @@ MatrixD& MatrixD::identity()
     return (*this);
 }
 
-void MatrixD::setColumn(S32 col, const Point4D &p)
+template <class T>
+void MatrixT<T>::setColumn(S32 col, const Point4DT<T> &p)
 {
     mData[col] = p.x;
     mData[col + 4] = p.y;
@@ -167,7 +180,8 @@ void MatrixD::setColumn(S32 col, const Point4D &p)
     mData[col + 12] = p.w;
 }
 
-void MatrixD::setRow(S32 row, const Point4D &p)
+template <class T>
+void MatrixT<T>::setRow(S32 row, const Point4DT<T> &p)
 {
     row *= 4;
     mData[row] = p.x;
@@ -176,41 +190,50 @@ void MatrixD::setRow(S32 row, const Point4D &p)
     mData[row + 3] = p.w;
 }
 
-void MatrixD::mul(Point3D &p) const
+template <class T>
+void MatrixT<T>::mul(Point3DT<T> &p) const
 {
-    Point3D tmp(p);
-    matD_x_point3D(*this, &p.x, &tmp.x);
+    Point3DT<T> tmp(p);
+    matD_x_point3D<T>(*this, &p.x, &tmp.x);
     p = tmp;
 }
 
-void MatrixD::mul(Point4D &p)  const
+template <class T>
+void MatrixT<T>::mul(Point4DT<T> &p)  const
 {
-    Point4D tmp(p);
-    matD_x_point4D(*this, &p.x, &tmp.x);
+    Point4DT<T> tmp(p);
+    matD_x_point4D<T>(*this, &p.x, &tmp.x);
     p = tmp;
 }
 
-MatrixD& MatrixD::mul(const MatrixD &a)
+template <class T>
+MatrixT<T>& MatrixT<T>::mul(const MatrixT &a)
 {
-    MatrixD tmp(*this);
-    matD_x_matD(tmp, a, *this);
+    MatrixT tmp(*this);
+    matD_x_matD<T>(tmp, a, *this);
     return  *this;
 }
 
-MatrixD& MatrixD::mul(const MatrixD &a, const MatrixD &b)
+template <class T>
+MatrixT<T>& MatrixT<T>::mul(const MatrixT &a, const MatrixT &b)
 {
-    matD_x_matD(a, b, *this);
+    matD_x_matD<T>(a, b, *this);
     return  *this;
 }
 
-MatrixD& MatrixD::inverse()
+template <class T>
+MatrixT<T>& MatrixT<T>::inverse()
 {
     matD_inverse(mData);
     return (*this);
 }
 
-MatrixD& MatrixD::transpose()
+template <class T>
+MatrixT<T>& MatrixT<T>::transpose()
 {
     matD_transpose(mData);
     return (*this);
 }
+
+template class MatrixT<F32>;
+template class MatrixT<F64>;
\ No newline at end of file
@@ -5,35 +5,40 @@
 #include "platform/platform.h"
 #endif
 
-class Point3D;
-class Point4D;
+#ifndef _POINT_H_
+#include "math/point.h"
+#endif
 
-class MatrixD
+template <class T>
+class MatrixT
 {
 public:
-    MatrixD();
+    MatrixT();
     
     bool isIdentity() const;
-    MatrixD& identity();
+    MatrixT& identity();
     
-    void setColumn(S32 col, const Point4D &p);
-    void setRow(S32 row, const Point4D &p);
+    void setColumn(S32 col, const Point4DT<T> &p);
+    void setRow(S32 row, const Point4DT<T> &p);
     
-    operator F64*() { return mData; }
-    operator F64*() const { return  (F64*) mData; }
+    operator T*() { return mData; }
+    operator T*() const { return  (T*) mData; }
     
-    void mul(Point3D &p) const;
-    void mul(Point4D &p) const;
+    void mul(Point3DT<T> &p) const;
+    void mul(Point4DT<T> &p) const;
     
-    MatrixD& mul(const MatrixD &a);
-    MatrixD& mul(const MatrixD &a, const MatrixD &b);
+    MatrixT& mul(const MatrixT &a);
+    MatrixT& mul(const MatrixT &a, const MatrixT &b);
     
-    MatrixD& inverse();
-    MatrixD& transpose();
+    MatrixT& inverse();
+    MatrixT& transpose();
 private:
-    F64 mData[16];
+    T mData[16];
 };
 
+// Instantiated for F32 and F64 in matrix.cc
+typedef MatrixT<Real> MatrixD;
+
 #endif
 
 
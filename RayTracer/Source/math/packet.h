@@ -0,0 +1,397 @@
+#ifndef _PACKET_H_
+#define _PACKET_H_
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+#include <math.h>
+
+#ifdef USE_SSE2
+#include <emmintrin.h>
+#endif
+
+class PacketMask;
+
+// Four F32 lanes, a single SSE register when available. Holds the channels of
+// a ColorF or a row of a single precision matrix
+class PacketF32
+{
+public:
+    enum { SIZE = 4 };
+    
+    PacketF32() {}
+    PacketF32(F32 value);
+    PacketF32(F32 a, F32 b, F32 c, F32 d);
+    PacketF32(const F32 *values);
+    
+    void store(F32 *values) const;
+    
+    PacketF32 operator+(const PacketF32 &p) const;
+    PacketF32 operator-(const PacketF32 &p) const;
+    PacketF32 operator*(const PacketF32 &p) const;
+    PacketF32 operator/(const PacketF32 &p) const;
+    
+    friend PacketF32 minimum(const PacketF32 &a, const PacketF32 &b);
+    friend PacketF32 maximum(const PacketF32 &a, const PacketF32 &b);
+    
+private:
+#ifdef USE_SSE2
+    PacketF32(__m128 _v) : v(_v) {}
+    
+    __m128 v;
+#else
+    F32 v[SIZE];
+#endif
+};
+
+// Four F64 lanes worked on at once, two SSE2 registers when available. Every
+// operation rounds like its scalar F64 counterpart, so a kernel written with
+// packets gives the same results as the scalar code it mirrors.
+class PacketF64
+{
+public:
+    enum { SIZE = 4 };
+    
+    PacketF64() {}
+    PacketF64(F64 value);
+    PacketF64(F64 a, F64 b, F64 c, F64 d);
+    PacketF64(const F64 *values);
+    
+    void store(F64 *values) const;
+    
+    PacketF64 operator-() const;
+    PacketF64 operator+(const PacketF64 &p) const;
+    PacketF64 operator-(const PacketF64 &p) const;
+    PacketF64 operator*(const PacketF64 &p) const;
+    PacketF64 operator/(const PacketF64 &p) const;
+    
+    PacketMask operator<(const PacketF64 &p) const;
+    PacketMask operator<=(const PacketF64 &p) const;
+    PacketMask operator>(const PacketF64 &p) const;
+    PacketMask operator>=(const PacketF64 &p) const;
+    
+    friend PacketF64 sqrt(const PacketF64 &p);
+    // Lanes of a where mask is set, b elsewhere
+    friend PacketF64 select(const PacketMask &mask, const PacketF64 &a, const PacketF64 &b);
+    
+private:
+#ifdef USE_SSE2
+    PacketF64(__m128d _lo, __m128d _hi) : lo(_lo), hi(_hi) {}
+    
+    __m128d lo;
+    __m128d hi;
+#else
+    F64 v[SIZE];
+#endif
+};
+
+// Result of a lane by lane comparison
+class PacketMask
+{
+public:
+    // One bit per lane, lane 0 in the lowest bit
+    U32 getBits() const;
+    
+    PacketMask operator&(const PacketMask &m) const;
+    PacketMask operator|(const PacketMask &m) const;
+    
+private:
+    friend class PacketF64;
+    friend PacketF64 select(const PacketMask &mask, const PacketF64 &a, const PacketF64 &b);
+    
+#ifdef USE_SSE2
+    PacketMask(__m128d _lo, __m128d _hi) : lo(_lo), hi(_hi) {}
+    
+    __m128d lo;
+    __m128d hi;
+#else
+    PacketMask(U32 _bits) : bits(_bits) {}
+    
+    U32 bits;
+#endif
+};
+
+// Packet of four T, for code templated on the scalar type
+template <class T> class PacketOf;
+template <> class PacketOf<F32> { public: typedef PacketF32 Type; };
+template <> class PacketOf<F64> { public: typedef PacketF64 Type; };
+
+// Inlines
+
+#ifdef USE_SSE2
+
+inline PacketF32::PacketF32(F32 value) : v(_mm_set1_ps(value))
+{}
+
+inline PacketF32::PacketF32(F32 a, F32 b, F32 c, F32 d) : v(_mm_setr_ps(a, b, c, d))
+{}
+
+inline PacketF32::PacketF32(const F32 *values) : v(_mm_loadu_ps(values))
+{}
+
+inline void PacketF32::store(F32 *values) const
+{
+    _mm_storeu_ps(values, v);
+}
+
+inline PacketF32 PacketF32::operator+(const PacketF32 &p) const
+{
+    return PacketF32(_mm_add_ps(v, p.v));
+}
+
+inline PacketF32 PacketF32::operator-(const PacketF32 &p) const
+{
+    return PacketF32(_mm_sub_ps(v, p.v));
+}
+
+inline PacketF32 PacketF32::operator*(const PacketF32 &p) const
+{
+    return PacketF32(_mm_mul_ps(v, p.v));
+}
+
+inline PacketF32 PacketF32::operator/(const PacketF32 &p) const
+{
+    return PacketF32(_mm_div_ps(v, p.v));
+}
+
+inline PacketF32 minimum(const PacketF32 &a, const PacketF32 &b)
+{
+    return PacketF32(_mm_min_ps(a.v, b.v));
+}
+
+inline PacketF32 maximum(const PacketF32 &a, const PacketF32 &b)
+{
+    return PacketF32(_mm_max_ps(a.v, b.v));
+}
+
+inline PacketF64::PacketF64(F64 value) : lo(_mm_set1_pd(value)), hi(_mm_set1_pd(value))
+{}
+
+inline PacketF64::PacketF64(F64 a, F64 b, F64 c, F64 d) : lo(_mm_setr_pd(a, b)), hi(_mm_setr_pd(c, d))
+{}
+
+inline PacketF64::PacketF64(const F64 *values) : lo(_mm_loadu_pd(values)), hi(_mm_loadu_pd(values + 2))
+{}
+
+inline void PacketF64::store(F64 *values) const
+{
+    _mm_storeu_pd(values, lo);
+    _mm_storeu_pd(values + 2, hi);
+}
+
+inline PacketF64 PacketF64::operator-() const
+{
+    __m128d sign = _mm_set1_pd(-0.0);
+    return PacketF64(_mm_xor_pd(lo, sign), _mm_xor_pd(hi, sign));
+}
+
+inline PacketF64 PacketF64::operator+(const PacketF64 &p) const
+{
+    return PacketF64(_mm_add_pd(lo, p.lo), _mm_add_pd(hi, p.hi));
+}
+
+inline PacketF64 PacketF64::operator-(const PacketF64 &p) const
+{
+    return PacketF64(_mm_sub_pd(lo, p.lo), _mm_sub_pd(hi, p.hi));
+}
+
+inline PacketF64 PacketF64::operator*(const PacketF64 &p) const
+{
+    return PacketF64(_mm_mul_pd(lo, p.lo), _mm_mul_pd(hi, p.hi));
+}
+
+inline PacketF64 PacketF64::operator/(const PacketF64 &p) const
+{
+    return PacketF64(_mm_div_pd(lo, p.lo), _mm_div_pd(hi, p.hi));
+}
+
+inline PacketMask PacketF64::operator<(const PacketF64 &p) const
+{
+    return PacketMask(_mm_cmplt_pd(lo, p.lo), _mm_cmplt_pd(hi, p.hi));
+}
+
+inline PacketMask PacketF64::operator<=(const PacketF64 &p) const
+{
+    return PacketMask(_mm_cmple_pd(lo, p.lo), _mm_cmple_pd(hi, p.hi));
+}
+
+inline PacketMask PacketF64::operator>(const PacketF64 &p) const
+{
+    return PacketMask(_mm_cmpgt_pd(lo, p.lo), _mm_cmpgt_pd(hi, p.hi));
+}
+
+inline PacketMask PacketF64::operator>=(const PacketF64 &p) const
+{
+    return PacketMask(_mm_cmpge_pd(lo, p.lo), _mm_cmpge_pd(hi, p.hi));
+}
+
+inline PacketF64 sqrt(const PacketF64 &p)
+{
+    return PacketF64(_mm_sqrt_pd(p.lo), _mm_sqrt_pd(p.hi));
+}
+
+inline PacketF64 select(const PacketMask &mask, const PacketF64 &a, const PacketF64 &b)
+{
+    return PacketF64(_mm_or_pd(_mm_and_pd(mask.lo, a.lo), _mm_andnot_pd(mask.lo, b.lo)),
+                     _mm_or_pd(_mm_and_pd(mask.hi, a.hi), _mm_andnot_pd(mask.hi, b.hi)));
+}
+
+inline U32 PacketMask::getBits() const
+{
+    return U32(_mm_movemask_pd(lo) | (_mm_movemask_pd(hi) << 2));
+}
+
+inline PacketMask PacketMask::operator&(const PacketMask &m) const
+{
+    return PacketMask(_mm_and_pd(lo, m.lo), _mm_and_pd(hi, m.hi));
+}
+
+inline PacketMask PacketMask::operator|(const PacketMask &m) const
+{
+    return PacketMask(_mm_or_pd(lo, m.lo), _mm_or_pd(hi, m.hi));
+}
+
+#else
+
+inline PacketF32::PacketF32(F32 value)
+{
+    for (U32 i = 0; i < SIZE; i++)
+        v[i] = value;
+}
+
+inline PacketF32::PacketF32(F32 a, F32 b, F32 c, F32 d)
+{
+    v[0] = a;
+    v[1] = b;
+    v[2] = c;
+    v[3] = d;
+}
+
+inline PacketF32::PacketF32(const F32 *values)
+{
+    for (U32 i = 0; i < SIZE; i++)
+        v[i] = values[i];
+}
+
+inline void PacketF32::store(F32 *values) const
+{
+    for (U32 i = 0; i < SIZE; i++)
+        values[i] = v[i];
+}
+
+#define PACKET_OP(type, op) \
+    type r; \
+    for (U32 i = 0; i < SIZE; i++) \
+        r.v[i] = v[i] op p.v[i]; \
+    return r;
+
+inline PacketF32 PacketF32::operator+(const PacketF32 &p) const { PACKET_OP(PacketF32, +) }
+inline PacketF32 PacketF32::operator-(const PacketF32 &p) const { PACKET_OP(PacketF32, -) }
+inline PacketF32 PacketF32::operator*(const PacketF32 &p) const { PACKET_OP(PacketF32, *) }
+inline PacketF32 PacketF32::operator/(const PacketF32 &p) const { PACKET_OP(PacketF32, /) }
+
+// Same NaN handling as minps and maxps, the second operand wins
+inline PacketF32 minimum(const PacketF32 &a, const PacketF32 &b)
+{
+    PacketF32 r;
+    for (U32 i = 0; i < PacketF32::SIZE; i++)
+        r.v[i] = (a.v[i] < b.v[i])? a.v[i] : b.v[i];
+    return r;
+}
+
+inline PacketF32 maximum(const PacketF32 &a, const PacketF32 &b)
+{
+    PacketF32 r;
+    for (U32 i = 0; i < PacketF32::SIZE; i++)
+        r.v[i] = (a.v[i] > b.v[i])? a.v[i] : b.v[i];
+    return r;
+}
+
+inline PacketF64::PacketF64(F64 value)
+{
+    for (U32 i = 0; i < SIZE; i++)
+        v[i] = value;
+}
+
+inline PacketF64::PacketF64(F64 a, F64 b, F64 c, F64 d)
+{
+    v[0] = a;
+    v[1] = b;
+    v[2] = c;
+    v[3] = d;
+}
+
+inline PacketF64::PacketF64(const F64 *values)
+{
+    for (U32 i = 0; i < SIZE; i++)
+        v[i] = values[i];
+}
+
+inline void PacketF64::store(F64 *values) const
+{
+    for (U32 i = 0; i < SIZE; i++)
+        values[i] = v[i];
+}
+
+#define PACKET_CMP(op) \
+    U32 bits = 0; \
+    for (U32 i = 0; i < SIZE; i++) \
+        bits |= (v[i] op p.v[i])? (1 << i) : 0; \
+    return PacketMask(bits);
+
+inline PacketF64 PacketF64::operator-() const
+{
+    PacketF64 r;
+    for (U32 i = 0; i < SIZE; i++)
+        r.v[i] = -v[i];
+    return r;
+}
+
+inline PacketF64 PacketF64::operator+(const PacketF64 &p) const { PACKET_OP(PacketF64, +) }
+inline PacketF64 PacketF64::operator-(const PacketF64 &p) const { PACKET_OP(PacketF64, -) }
+inline PacketF64 PacketF64::operator*(const PacketF64 &p) const { PACKET_OP(PacketF64, *) }
+inline PacketF64 PacketF64::operator/(const PacketF64 &p) const { PACKET_OP(PacketF64, /) }
+
+inline PacketMask PacketF64::operator<(const PacketF64 &p) const { PACKET_CMP(<) }
+inline PacketMask PacketF64::operator<=(const PacketF64 &p) const { PACKET_CMP(<=) }
+inline PacketMask PacketF64::operator>(const PacketF64 &p) const { PACKET_CMP(>) }
+inline PacketMask PacketF64::operator>=(const PacketF64 &p) const { PACKET_CMP(>=) }
+
+#undef PACKET_OP
+#undef PACKET_CMP
+
+inline PacketF64 sqrt(const PacketF64 &p)
+{
+    PacketF64 r;
+    for (U32 i = 0; i < PacketF64::SIZE; i++)
+        r.v[i] = sqrt(p.v[i]);
+    return r;
+}
+
+inline PacketF64 select(const PacketMask &mask, const PacketF64 &a, const PacketF64 &b)
+{
+    PacketF64 r;
+    for (U32 i = 0; i < PacketF64::SIZE; i++)
+        r.v[i] = (mask.bits & (1 << i))? a.v[i] : b.v[i];
+    return r;
+}
+
+inline U32 PacketMask::getBits() const
+{
+    return bits;
+}
+
+inline PacketMask PacketMask::operator&(const PacketMask &m) const
+{
+    return PacketMask(bits & m.bits);
+}
+
+inline PacketMask PacketMask::operator|(const PacketMask &m) const
+{
+    return PacketMask(bits | m.bits);
+}
+
+#endif
+
+#endif
\ No newline at end of file
@@ -7,108 +7,134 @@
 
 #include <math.h>
 
-class Point3D
+// Scalar type of the math classes used by the renderer. Double precision by
+// default, builds with USE_F32_MATH defined use single precision instead,
+// which halves the size of the geometry at the cost of the accuracy noted
+// next to EPSILON in math.h
+#ifdef USE_F32_MATH
+typedef F32 Real;
+#else
+typedef F64 Real;
+#endif
+
+template <class T>
+class Point3DT
 {
 public:
-    F64 x;
-    F64 y;
-    F64 z;
+    T x;
+    T y;
+    T z;
     
-    Point3D();
-    Point3D(const Point3D&);
-    Point3D(const F64 _x, const F64 _y, const F64 _z);
+    Point3DT();
+    Point3DT(const Point3DT&);
+    Point3DT(const T _x, const T _y, const T _z);
     
-    void set(const F64 _x, const F64 _y, const F64 _z);
+    void set(const T _x, const T _y, const T _z);
     
-    F64 length() const;
+    T length() const;
     
     void normalize();
     
-    Point3D  operator+(const Point3D&) const;
-    Point3D  operator-(const Point3D&) const;
-    Point3D& operator+=(const Point3D&);
-    Point3D& operator-=(const Point3D&);
+    Point3DT  operator+(const Point3DT&) const;
+    Point3DT  operator-(const Point3DT&) const;
+    Point3DT& operator+=(const Point3DT&);
+    Point3DT& operator-=(const Point3DT&);
     
-    Point3D  operator*(const F64) const;
-    Point3D  operator/(const F64) const;
-    Point3D& operator*=(const F64);
-    Point3D& operator/=(const F64);
+    Point3DT  operator*(const T) const;
+    Point3DT  operator/(const T) const;
+    Point3DT& operator*=(const T);
+    Point3DT& operator/=(const T);
 };
 
-class Point4D
+template <class T>
+class Point4DT
 {
 public:
-    F64 x;
-    F64 y;
-    F64 z;
-    F64 w;
+    T x;
+    T y;
+    T z;
+    T w;
     
-    Point4D();
-    Point4D(const Point4D&);
-    Point4D(const F64 _x, const F64 _y, const F64 _z, const F64 _w);
+    Point4DT();
+    Point4DT(const Point4DT&);
+    Point4DT(const T _x, const T _y, const T _z, const T _w);
     
-    void set(const F64 _x, const F64 _y, const F64 _z, const F64 _w);
+    void set(const T _x, const T _y, const T _z, const T _w);
 };
 
-class PointUV
+template <class T>
+class PointUVT
 {
 public:
-    F64 u;
-    F64 v;
+    T u;
+    T v;
     
-    PointUV();
-    PointUV(const PointUV&);
-    PointUV(const F64 _u, const F64 _v);
+    PointUVT();
+    PointUVT(const PointUVT&);
+    PointUVT(const T _u, const T _v);
     
-    void set(const F64 _u, const F64 _v);
+    void set(const T _u, const T _v);
     
-    PointUV  operator-(const PointUV&) const;
+    PointUVT  operator-(const PointUVT&) const;
 };
 
+typedef Point3DT<Real> Point3D;
+typedef Point4DT<Real> Point4D;
+typedef PointUVT<Real> PointUV;
+
 // Inlines Point3D
 
-inline Point3D::Point3D()
+template <class T>
+inline Point3DT<T>::Point3DT()
 {}
 
 
-inline Point3D::Point3D(const Point3D& copy) : x(copy.x), y(copy.y), z(copy.z)
+template <class T>
+inline Point3DT<T>::Point3DT(const Point3DT& copy) : x(copy.x), y(copy.y), z(copy.z)
 {}
 
 
-inline Point3D::Point3D(const F64 _x, const F64 _y, const F64 _z) : x(_x), y(_y), z(_z)
+template <class T>
+inline Point3DT<T>::Point3DT(const T _x, const T _y, const T _z) : x(_x), y(_y), z(_z)
 {}
 
-inline F64 Point3D::length() const
+template <class T>
+inline T Point3DT<T>::length() const
 {
     return sqrt(x*x + y*y + z*z);
 }
 
-inline void Point3D::set(const F64 _x, const F64 _y, const F64 _z)
+template <class T>
+inline void Point3DT<T>::set(const T _x, const T _y, const T _z)
 {
     x = _x;
     y = _y;
     z = _z;
 }
 
-inline void Point3D::normalize()
+template <class T>
+inline void Point3DT<T>::normalize()
 {
-    F64 l = 1.0 / length();
+    T l = T(1.0) / length();
     x *= l;
     y *= l;
     z *= l;
 }
 
-inline Point3D Point3D::operator+(const Point3D& add) const
+template <class T>
+inline Point3DT<T> Point3DT<T>::operator+(const Point3DT& add) const
 {
-    return Point3D(x + add.x, y + add.y, z + add.z);
+    return Point3DT(x + add.x, y + add.y, z + add.z);
 }
 
-inline Point3D Point3D::operator-(const Point3D& sub) const
+template <class T>
+inline Point3DT<T> Point3DT<T>::operator-(const Point3DT& sub) const
 {
-    return Point3D(x - sub.x, y - sub.y, z - sub.z);
+    return Point3DT(x - sub.x, y - sub.y, z - sub.z);
 }
 
-inline Point3D& Point3D::operator+=(const Point3D& add)
+template <class T>
+inline Point3DT<T>& Point3DT<T>::operator+=(const Point3DT& add)
 {
     x += add.x;
     y += add.y;
@@ -116,7 +142,8 @@ inline Point3D& Point3D::operator+=(const Point3D& add)
     return *this;
 }
 
-inline Point3D& Point3D::operator-=(const Point3D& sub)
+template <class T>
+inline Point3DT<T>& Point3DT<T>::operator-=(const Point3DT& sub)
 {
     x -= sub.x;
     y -= sub.y;
@@ -124,17 +151,20 @@ inline Point3D& Point3D::operator-=(const Point3D& sub)
     return *this;
 }
 
-inline Point3D Point3D::operator*(const F64 mul) const
+template <class T>
+inline Point3DT<T> Point3DT<T>::operator*(const T mul) const
 {
-    return Point3D(x * mul, y * mul, z * mul);
+    return Point3DT(x * mul, y * mul, z * mul);
 }
 
-inline Point3D Point3D::operator/(const F64 div) const
+template <class T>
+inline Point3DT<T> Point3DT<T>::operator/(const T div) const
 {
-    return Point3D(x / div, y / div, z / div);
+    return Point3DT(x / div, y / div, z / div);
 }
 
-inline Point3D& Point3D::operator*=(const F64 mul)
+template <class T>
+inline Point3DT<T>& Point3DT<T>::operator*=(const T mul)
 {
     x *= mul;
     y *= mul;
@@ -142,7 +172,8 @@ inline Point3D& Point3D::operator*=(const F64 mul)
     return *this;
 }
 
-inline Point3D& Point3D::operator/=(const F64 div)
+template <class T>
+inline Point3DT<T>& Point3DT<T>::operator/=(const T div)
 {
     x /= div;
     y /= div;
@@ -152,18 +183,22 @@ inline Point3D& Point3D::operator/=(const F64 div)
 
 // Inlines Point4D
 
-inline Point4D::Point4D()
+template <class T>
+inline Point4DT<T>::Point4DT()
 {}
 
 
-inline Point4D::Point4D(const Point4D& copy) : x(copy.x), y(copy.y), z(copy.z), w(copy.w)
+template <class T>
+inline Point4DT<T>::Point4DT(const Point4DT& copy) : x(copy.x), y(copy.y), z(copy.z), w(copy.w)
 {}
 
 
-inline Point4D::Point4D(const F64 _x, const F64 _y, const F64 _z, const F64 _w) : x(_x), y(_y), z(_z), w(_w)
+template <class T>
+inline Point4DT<T>::Point4DT(const T _x, const T _y, const T _z, const T _w) : x(_x), y(_y), z(_z), w(_w)
 {}
 
-inline void Point4D::set(const F64 _x, const F64 _y, const F64 _z, const F64 _w)
+template <class T>
+inline void Point4DT<T>::set(const T _x, const T _y, const T _z, const T _w)
 {
     x = _x;
     y = _y;
@@ -171,32 +206,37 @@ inline void Point4D::set(const F64 _x, const F64 _y, const F64 _z, const F64 _w)
     w = _w;
 }
 
-inline PointUV::PointUV()
+template <class T>
+inline PointUVT<T>::PointUVT()
 {
     //
 }
 
-inline PointUV::PointUV(const PointUV& copy)
+template <class T>
+inline PointUVT<T>::PointUVT(const PointUVT& copy)
 {
     u = copy.u;
     v = copy.v;
 }
 
-inline PointUV::PointUV(const F64 _u, const F64 _v)
+template <class T>
+inline PointUVT<T>::PointUVT(const T _u, const T _v)
 {
     u = _u;
     v = _v;
 }
 
-inline void PointUV::set(const F64 _u, const F64 _v)
+template <class T>
+inline void PointUVT<T>::set(const T _u, const T _v)
 {
     u = _u;
     v = _v;
 }
 
-inline PointUV  PointUV::operator-(const PointUV& sub) const
+template <class T>
+inline PointUVT<T> PointUVT<T>::operator-(const PointUVT& sub) const
 {
-    return PointUV(u - sub.u, v - sub.v);
+    return PointUVT(u - sub.u, v - sub.v);
 }
 
 #endif
\ No newline at end of file
@@ -1,20 +1,25 @@
 #ifndef _RAY_H_
 #define _RAY_H_
 
-class Point3D;
+#ifndef _POINT_H_
+#include "math/point.h"
+#endif
 
-class Ray
+template <class T>
+class RayT
 {
 private:
-    Point3D mOrigin;
-    Point3D mDirection;
+    Point3DT<T> mOrigin;
+    Point3DT<T> mDirection;
 public:
     
-    Ray(const Point3D &origin, const Point3D &direction) : mOrigin(origin), mDirection(direction)
+    RayT(const Point3DT<T> &origin, const Point3DT<T> &direction) : mOrigin(origin), mDirection(direction)
     {}
     
-    const Point3D& getOrigin() const { return mOrigin; }
-    const Point3D& getDirection() const { return mDirection; }
+    const Point3DT<T>& getOrigin() const { return mOrigin; }
+    const Point3DT<T>& getDirection() const { return mDirection; }
 };
 
+typedef RayT<Real> Ray;
+
 #endif
\ No newline at end of file
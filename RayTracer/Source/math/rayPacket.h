@@ -0,0 +1,92 @@
+#ifndef _RAYPACKET_H_
+#define _RAYPACKET_H_
+
+#ifndef _PACKET_H_
+#include "math/packet.h"
+#endif
+
+#ifndef _POINT_H_
+#include "math/point.h"
+#endif
+
+#ifndef _RAY_H_
+#include "math/ray.h"
+#endif
+
+// Rays traced together, stored component by component so a kernel loads
+// each one straight into a PacketF64. Lanes without a ray are left out of
+// the mask.
+class RayPacket
+{
+public:
+    enum { SIZE = PacketF64::SIZE, FULL_MASK = (1 << SIZE) - 1 };
+    
+    RayPacket() : mMask(0) {}
+    
+    void setRay(U32 lane, const Ray &ray);
+    Ray getRay(U32 lane) const;
+    U32 getMask() const { return mMask; }
+    
+    // True if the rays start at the same point and their directions have the
+    // same signs, a packet that splits early is better traced ray by ray
+    bool isCoherent() const;
+    
+    PacketF64 getOrigin(U32 axis) const { return PacketF64(mOrigin[axis]); }
+    PacketF64 getDirection(U32 axis) const { return PacketF64(mDirection[axis]); }
+    
+private:
+    F64 mOrigin[3][SIZE];
+    F64 mDirection[3][SIZE];
+    U32 mMask;
+};
+
+// Inlines
+
+inline void RayPacket::setRay(U32 lane, const Ray &ray)
+{
+    const Point3D &origin = ray.getOrigin();
+    const Point3D &direction = ray.getDirection();
+    
+    mOrigin[0][lane] = origin.x;
+    mOrigin[1][lane] = origin.y;
+    mOrigin[2][lane] = origin.z;
+    mDirection[0][lane] = direction.x;
+    mDirection[1][lane] = direction.y;
+    mDirection[2][lane] = direction.z;
+    mMask |= 1 << lane;
+}
+
+inline Ray RayPacket::getRay(U32 lane) const
+{
+    return Ray(Point3D(mOrigin[0][lane], mOrigin[1][lane], mOrigin[2][lane]),
+               Point3D(mDirection[0][lane], mDirection[1][lane], mDirection[2][lane]));
+}
+
+inline bool RayPacket::isCoherent() const
+{
+    S32 first = -1;
+    
+    for (U32 lane = 0; lane < SIZE; lane++)
+    {
+        if (!(mMask & (1 << lane)))
+            continue;
+        
+        if (first < 0)
+        {
+            first = lane;
+            continue;
+        }
+        
+        for (U32 axis = 0; axis < 3; axis++)
+        {
+            if (mOrigin[axis][lane] != mOrigin[axis][first] ||
+                (mDirection[axis][lane] < 0.0) != (mDirection[axis][first] < 0.0))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#endif
\ No newline at end of file
@@ -10,6 +10,9 @@ typedef unsigned short     U16;
 typedef signed int         S32;
 typedef unsigned int       U32;
 
+typedef signed long long   S64;
+typedef unsigned long long U64;
+
 typedef float              F32;
 typedef double             F64;
 
@@ -23,6 +26,18 @@ typedef double             F64;
 
 #define WIN32_LEAN_AND_MEAN
 
+#ifdef _MSC_VER
+#  define THREAD_LOCAL __declspec(thread)
+#else
+#  define THREAD_LOCAL __thread
+#endif
+
+// SSE2 is always there on x64, 32 bit builds need /arch:SSE2. Define NO_SSE2
+// to build the portable code instead
+#if !defined(NO_SSE2) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+#  define USE_SSE2
+#endif
+
 #include <windows.h>
 
 inline U32 convertLEndianToBEndian(U32 i)
@@ -178,4 +178,78 @@ File::Status File::write(U32 size, const void *src, U32 *bytesWritten)
         else
             return setStatus();
     }
+}
+
+bool File::getInfo(const char *filename, U64 &modifiedTime, U64 &size)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    
+    if (0 == GetFileAttributesEx(filename, GetFileExInfoStandard, &data))
+        return false;
+    
+    modifiedTime = (U64(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+    size = (U64(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    return true;
+}
+
+MappedFile::MappedFile() : mMapping(NULL), mData(NULL), mSize(0)
+{
+    mHandle = (void *)INVALID_HANDLE_VALUE;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char *filename)
+{
+    close();
+    mHandle = (void *)CreateFile(filename,
+                                 GENERIC_READ,
+                                 FILE_SHARE_READ,
+                                 NULL,
+                                 OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL,
+                                 NULL);
+    
+    if (INVALID_HANDLE_VALUE == (HANDLE) mHandle)
+        return false;
+    
+    mSize = GetFileSize((HANDLE) mHandle, NULL);
+    
+    if (mSize == 0 || mSize == INVALID_FILE_SIZE)
+    {
+        close();
+        return false;
+    }
+    
+    mMapping = (void *)CreateFileMapping((HANDLE) mHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    
+    if (mMapping)
+        mData = (const U8 *)MapViewOfFile((HANDLE) mMapping, FILE_MAP_READ, 0, 0, 0);
+    
+    if (!mData)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mData)
+        UnmapViewOfFile(mData);
+    
+    if (mMapping)
+        CloseHandle((HANDLE) mMapping);
+    
+    if (INVALID_HANDLE_VALUE != (HANDLE) mHandle)
+        CloseHandle((HANDLE) mHandle);
+    
+    mHandle = (void *)INVALID_HANDLE_VALUE;
+    mMapping = NULL;
+    mData = NULL;
+    mSize = 0;
 }
\ No newline at end of file
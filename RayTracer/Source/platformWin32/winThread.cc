@@ -0,0 +1,72 @@
+#include <windows.h>
+#include <assert.h>
+#include "core/thread.h"
+
+static DWORD WINAPI threadProc(LPVOID arg)
+{
+    Thread *thread = (Thread *) arg;
+    thread->run();
+    return 0;
+}
+
+Thread::Thread(Function function, void *arg) : mFunction(function), mArg(arg), mHandle(NULL)
+{
+}
+
+Thread::~Thread()
+{
+    join();
+}
+
+bool Thread::start()
+{
+    assert(mHandle == NULL); // Thread already started
+    mHandle = (void *)CreateThread(NULL, 0, threadProc, this, 0, NULL);
+    return mHandle != NULL;
+}
+
+void Thread::join()
+{
+    if (mHandle == NULL)
+        return;
+    
+    WaitForSingleObject((HANDLE) mHandle, INFINITE);
+    CloseHandle((HANDLE) mHandle);
+    mHandle = NULL;
+}
+
+void Thread::run()
+{
+    mFunction(mArg);
+}
+
+U32 Thread::getProcessorCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0)? U32(info.dwNumberOfProcessors) : 1;
+}
+
+Mutex::Mutex()
+{
+    CRITICAL_SECTION *section = new CRITICAL_SECTION;
+    InitializeCriticalSection(section);
+    mHandle = section;
+}
+
+Mutex::~Mutex()
+{
+    CRITICAL_SECTION *section = (CRITICAL_SECTION *) mHandle;
+    DeleteCriticalSection(section);
+    delete section;
+}
+
+void Mutex::lock()
+{
+    EnterCriticalSection((CRITICAL_SECTION *) mHandle);
+}
+
+void Mutex::unlock()
+{
+    LeaveCriticalSection((CRITICAL_SECTION *) mHandle);
+}
\ No newline at end of file
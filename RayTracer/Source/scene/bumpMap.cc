@@ -1,7 +1,10 @@
+#include "core/memStream.h"
 #include "math/math.h"
 #include "scene/scene.h"
 #include <assert.h>
 
+#define HEIGHT_LEVELS (65535.0f)
+
 BumpMap::BumpMap() : mHeights(NULL)
 {
 }
@@ -9,21 +12,21 @@ BumpMap::BumpMap() : mHeights(NULL)
 BumpMap::~BumpMap()
 {
     if (mHeights)
-        free(mHeights);
+        delete[] mHeights;
 }
 
 void BumpMap::init(Texture *texture, F32 minHeight, F32 maxHeight)
 {
     if (mHeights)
-        delete mHeights;
+        delete[] mHeights;
     
     mMinHeight = minHeight;
     mMaxHeight = maxHeight;
+    mStep = (mMaxHeight - mMinHeight) / HEIGHT_LEVELS;
     width = texture->bitmap.width;
     height = texture->bitmap.height;
-    U32 size = width * height * sizeof(F32);
-    mHeights = new F32[size];
-    memset(mHeights, 0, size);
+    mHeights = new U16[width * height];
+    memset(mHeights, 0, width * height * sizeof(U16));
     ColorF c;
     F32 delta = mMaxHeight - mMinHeight;
     
@@ -43,4 +46,37 @@ void BumpMap::init(Texture *texture, F32 minHeight, F32 maxHeight)
             setHeight(i, j, height);
         }
     }
+    mDerivatives.init(*this);
+}
+
+void BumpMap::write(MemStream &stream) const
+{
+    Map::write(stream);
+    stream.write(mMinHeight);
+    stream.write(mMaxHeight);
+    stream.write(width * height * sizeof(U16), mHeights);
+}
+
+bool BumpMap::read(MemStream &stream)
+{
+    if (!Map::read(stream))
+        return false;
+    
+    stream.read(&mMinHeight);
+    stream.read(&mMaxHeight);
+    
+    if (!stream.isOk() || U64(width) * height * sizeof(U16) > stream.getRemaining())
+    {
+        stream.fail();
+        return false;
+    }
+    
+    mStep = (mMaxHeight - mMinHeight) / HEIGHT_LEVELS;
+    mHeights = new U16[width * height];
+    
+    if (!stream.read(width * height * sizeof(U16), mHeights))
+        return false;
+    
+    mDerivatives.init(*this);
+    return true;
 }
@@ -0,0 +1,293 @@
+#include <assert.h>
+#include "math/math.h"
+#include "scene/bvh.h"
+#include "scene/scene.h"
+#include "scene/sceneStream.h"
+
+#define SAH_BIN_COUNT (16)
+#define SAH_TRAVERSAL_COST (1.0)
+#define SAH_INTERSECTION_COST (1.0)
+
+BVH::BVH()
+{
+}
+
+void BVH::clear()
+{
+    mNodes.clear();
+    mObjects.clear();
+    mIndices.clear();
+}
+
+void BVH::build(const std::vector<SceneObject*> &objects)
+{
+    std::vector<BuildEntry> entries;
+    
+    clear();
+    entries.reserve(objects.size());
+    
+    for (std::vector<SceneObject*>::const_iterator walk = objects.begin(); walk != objects.end(); walk++)
+    {
+        BuildEntry entry;
+        
+        if (!(*walk)->getBounds(entry.bounds) || entry.bounds.isEmpty())
+            continue;
+        entry.center = entry.bounds.getCenter();
+        entry.obj = *walk;
+        entry.index = 0;
+        entries.push_back(entry);
+    }
+    
+    if (entries.empty())
+        return;
+    
+    mNodes.reserve(entries.size() * 2);
+    mObjects.reserve(entries.size());
+    build(entries, 0, (U32) entries.size(), 0);
+}
+
+void BVH::build(const std::vector<Box3D> &bounds)
+{
+    std::vector<BuildEntry> entries;
+    
+    clear();
+    entries.reserve(bounds.size());
+    
+    for (U32 i = 0; i < bounds.size(); i++)
+    {
+        BuildEntry entry;
+        
+        if (bounds[i].isEmpty())
+            continue;
+        entry.bounds = bounds[i];
+        entry.center = entry.bounds.getCenter();
+        entry.obj = NULL;
+        entry.index = i;
+        entries.push_back(entry);
+    }
+    
+    if (entries.empty())
+        return;
+    
+    mNodes.reserve(entries.size() * 2);
+    mIndices.reserve(entries.size());
+    build(entries, 0, (U32) entries.size(), 0);
+}
+
+U32 BVH::build(std::vector<BuildEntry> &entries, U32 start, U32 end, U32 depth)
+{
+    U32 index = (U32) mNodes.size();
+    Box3D centerBounds;
+    
+    mNodes.push_back(Node());
+    
+    Node node;
+    node.offset = 0;
+    node.count = 0;
+    node.axis = 0;
+    
+    for (U32 i = start; i < end; ++i)
+    {
+        node.bounds.extend(entries[i].bounds);
+        centerBounds.extend(entries[i].center);
+    }
+    
+    U32 count = end - start;
+    U32 middle = end;
+    
+    if (count > 1 && depth < MAX_DEPTH - 1)
+        middle = partition(entries, start, end, centerBounds, node.axis);
+    
+    if (middle == start || middle == end)
+    {
+        node.count = count;
+        
+        if (!entries[start].obj)
+        {
+            node.offset = (U32) mIndices.size();
+            for (U32 i = start; i < end; ++i)
+                mIndices.push_back(entries[i].index);
+            mNodes[index] = node;
+            return index;
+        }
+        
+        // Leaf, objects of the same type are kept together for the primitive
+        // pools. One pass per type keeps large leaves linear
+        node.offset = (U32) mObjects.size();
+        for (S32 type = 0; type < SceneObject::TYPE_COUNT; ++type)
+        {
+            for (U32 i = start; i < end; ++i)
+            {
+                if (entries[i].obj->getType() == type)
+                    mObjects.push_back(entries[i].obj);
+            }
+        }
+        mNodes[index] = node;
+        return index;
+    }
+    
+    build(entries, start, middle, depth + 1);
+    node.offset = build(entries, middle, end, depth + 1);
+    mNodes[index] = node;
+    return index;
+}
+
+// Returns the index of the first entry of the right half, or end when the
+// surface area heuristic prefers a leaf.
+U32 BVH::partition(std::vector<BuildEntry> &entries, U32 start, U32 end, const Box3D &centerBounds, U16 &axis)
+{
+    U32 count = end - start;
+    F64 bestCost = F64_MAX;
+    S32 bestAxis = -1;
+    S32 bestBin = 0;
+    
+    for (S32 a = 0; a < 3; ++a)
+    {
+        F64 minCenter = (&centerBounds.minExtents.x)[a];
+        F64 extent = (&centerBounds.maxExtents.x)[a] - minCenter;
+        
+        if (extent <= EPSILON)
+            continue;
+        
+        Box3D binBounds[SAH_BIN_COUNT];
+        U32 binCount[SAH_BIN_COUNT];
+        F64 scale = SAH_BIN_COUNT / extent;
+        
+        for (S32 b = 0; b < SAH_BIN_COUNT; ++b)
+            binCount[b] = 0;
+        
+        for (U32 i = start; i < end; ++i)
+        {
+            S32 b = min(S32(((&entries[i].center.x)[a] - minCenter) * scale), SAH_BIN_COUNT - 1);
+            binCount[b]++;
+            binBounds[b].extend(entries[i].bounds);
+        }
+        
+        // Sweep from the right to get the area and count of every right half
+        F64 rightArea[SAH_BIN_COUNT];
+        U32 rightCount[SAH_BIN_COUNT];
+        Box3D bounds;
+        U32 n = 0;
+        
+        for (S32 b = SAH_BIN_COUNT - 1; b > 0; --b)
+        {
+            bounds.extend(binBounds[b]);
+            n += binCount[b];
+            rightArea[b] = bounds.getSurfaceArea();
+            rightCount[b] = n;
+        }
+        
+        bounds.empty();
+        n = 0;
+        
+        for (S32 b = 0; b < SAH_BIN_COUNT - 1; ++b)
+        {
+            bounds.extend(binBounds[b]);
+            n += binCount[b];
+            
+            if (n == 0 || rightCount[b + 1] == 0)
+                continue;
+            
+            F64 cost = bounds.getSurfaceArea() * n + rightArea[b + 1] * rightCount[b + 1];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = a;
+                bestBin = b;
+            }
+        }
+    }
+    
+    Box3D bounds;
+    for (U32 i = start; i < end; ++i)
+        bounds.extend(entries[i].bounds);
+    F64 area = bounds.getSurfaceArea();
+    
+    if (bestAxis < 0)
+    {
+        // Every center falls in the same spot, split in half if the leaf is too big
+        if (count <= MAX_LEAF_SIZE)
+            return end;
+        axis = 0;
+        return start + count / 2;
+    }
+    
+    F64 leafCost = SAH_INTERSECTION_COST * count;
+    F64 splitCost = SAH_TRAVERSAL_COST + SAH_INTERSECTION_COST * bestCost / area;
+    
+    if (splitCost >= leafCost && count <= MAX_LEAF_SIZE)
+        return end;
+    
+    F64 minCenter = (&centerBounds.minExtents.x)[bestAxis];
+    F64 scale = SAH_BIN_COUNT / ((&centerBounds.maxExtents.x)[bestAxis] - minCenter);
+    U32 middle = start;
+    
+    for (U32 i = start; i < end; ++i)
+    {
+        S32 b = min(S32(((&entries[i].center.x)[bestAxis] - minCenter) * scale), SAH_BIN_COUNT - 1);
+        
+        if (b <= bestBin)
+        {
+            BuildEntry tmp = entries[i];
+            entries[i] = entries[middle];
+            entries[middle] = tmp;
+            middle++;
+        }
+    }
+    
+    axis = (U16) bestAxis;
+    return middle;
+}
+
+void BVH::write(SceneStream &stream) const
+{
+    stream.write((U32) mNodes.size());
+    if (!mNodes.empty())
+        stream.write((U32) (mNodes.size() * sizeof(Node)), &mNodes[0]);
+    
+    stream.write((U32) mObjects.size());
+    for (std::vector<const SceneObject*>::const_iterator walk = mObjects.begin(); walk != mObjects.end(); walk++)
+        stream.writeObject(*walk);
+}
+
+bool BVH::read(SceneStream &stream)
+{
+    U32 count = 0;
+    
+    clear();
+    if (!stream.read(&count) || U64(count) * sizeof(Node) > stream.getRemaining())
+    {
+        stream.fail();
+        return false;
+    }
+    
+    mNodes.resize(count);
+    if (count)
+        stream.read((U32) (count * sizeof(Node)), &mNodes[0]);
+    
+    count = 0;
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.isOk(); i++)
+    {
+        const SceneObject *object = stream.readObject();
+        
+        if (object)
+            mObjects.push_back(object);
+        else
+            stream.fail();
+    }
+    
+    // Leaves must stay inside the object list
+    for (std::vector<Node>::const_iterator walk = mNodes.begin(); walk != mNodes.end() && stream.isOk(); walk++)
+    {
+        if (walk->isLeaf()? walk->offset + walk->count > mObjects.size() : walk->offset >= mNodes.size())
+            stream.fail();
+    }
+    
+    if (!stream.isOk())
+    {
+        clear();
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,310 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <vector>
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+#include "math/math.h"
+
+class SceneObject;
+class SceneStream;
+
+// Bounding volume hierarchy over the bounded scene objects, or over the boxes of
+// the primitives of a single object. Nodes are stored depth first so the left
+// child of an interior node always follows its parent.
+class BVH
+{
+public:
+    enum { MAX_LEAF_SIZE = 4, MAX_DEPTH = 64 };
+    
+    class Node
+    {
+    public:
+        bool isLeaf() const { return count > 0; }
+        
+        Box3D bounds;
+        U32 offset;     // First object or index for leaves, right child for interior nodes
+        U32 count;      // Object count, zero for interior nodes. Leaves made
+                        // at MAX_DEPTH can hold any number of them
+        U16 axis;       // Split axis
+    };
+    
+    BVH();
+    
+    void build(const std::vector<SceneObject*> &objects);
+    // Tree over primitives given by their boxes, the leaves index getIndices()
+    void build(const std::vector<Box3D> &bounds);
+    void clear();
+    
+    // Objects are written as stream indices, they must be registered first
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
+    
+    bool isEmpty() const { return mNodes.empty(); }
+    U32 getNodeCount() const { return (U32) mNodes.size(); }
+    // Objects in leaf order, the objects of a leaf are sorted by type
+    const std::vector<const SceneObject*>& getObjects() const { return mObjects; }
+    // Primitive indices in leaf order, for trees built from boxes
+    const std::vector<U32>& getIndices() const { return mIndices; }
+    
+    // Visits the leaves pierced by the ray, front to back. The visitor is called
+    // as visitor(first, count, distance) with the range of getObjects() in the
+    // leaf and may shrink distance to prune farther nodes. Returning true stops
+    // the traversal.
+    template <class Visitor>
+    void traverse(const Ray &ray, F64 &distance, Visitor &visitor) const;
+    
+    // Packet version, a node is visited while any lane in mask reaches it.
+    // The visitor is called as visitor(first, count, distance, mask) with the
+    // lanes that reached the leaf and may shrink their distance.
+    template <class Visitor>
+    void traverse(const RayPacket &packet, F64 *distance, U32 mask, Visitor &visitor) const;
+    
+    // Visits the leaves whose bounds overlap box, as visitor(first, count).
+    // Returning true stops the traversal.
+    template <class Visitor>
+    void traverse(const Box3D &box, Visitor &visitor) const;
+    
+private:
+    class BuildEntry
+    {
+    public:
+        Box3D bounds;
+        Point3D center;
+        SceneObject *obj;
+        U32 index;
+    };
+    
+    U32 build(std::vector<BuildEntry> &entries, U32 start, U32 end, U32 depth);
+    U32 partition(std::vector<BuildEntry> &entries, U32 start, U32 end, const Box3D &centerBounds, U16 &axis);
+    
+private:
+    std::vector<Node> mNodes;
+    std::vector<const SceneObject*> mObjects;
+    std::vector<U32> mIndices;
+};
+
+// Inlines
+
+template <class Visitor>
+void BVH::traverse(const Ray &ray, F64 &distance, Visitor &visitor) const
+{
+    if (mNodes.empty())
+        return;
+    
+    const Point3D &origin = ray.getOrigin();
+    const Point3D &direction = ray.getDirection();
+    Point3D invDirection(1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z);
+    F64 tNear;
+    
+    if (!mNodes[0].bounds.intersect(origin, invDirection, distance, tNear))
+        return;
+    
+    U32 stack[MAX_DEPTH];
+    F64 stackDistance[MAX_DEPTH];
+    S32 top = 0;
+    U32 index = 0;
+    
+    while (true)
+    {
+        const Node &node = mNodes[index];
+        
+        if (node.isLeaf())
+        {
+            if (visitor(node.offset, node.count, distance))
+                return;
+        }
+        else
+        {
+            U32 nearIndex = index + 1;
+            U32 farIndex = node.offset;
+            F64 tLeft, tRight;
+            bool hitLeft = mNodes[nearIndex].bounds.intersect(origin, invDirection, distance, tLeft);
+            bool hitRight = mNodes[farIndex].bounds.intersect(origin, invDirection, distance, tRight);
+            
+            if (hitLeft && hitRight)
+            {
+                F64 tFar = tRight;
+                
+                if (tRight < tLeft)
+                {
+                    nearIndex = node.offset;
+                    farIndex = index + 1;
+                    tFar = tLeft;
+                }
+                stack[top] = farIndex;
+                stackDistance[top] = tFar;
+                top++;
+                index = nearIndex;
+                continue;
+            }
+            else if (hitLeft)
+            {
+                index = nearIndex;
+                continue;
+            }
+            else if (hitRight)
+            {
+                index = farIndex;
+                continue;
+            }
+        }
+        
+        // Pop the next node that can still hold a closer hit
+        do
+        {
+            if (top == 0)
+                return;
+            top--;
+            index = stack[top];
+        } while (stackDistance[top] > distance);
+    }
+}
+
+template <class Visitor>
+void BVH::traverse(const RayPacket &packet, F64 *distance, U32 mask, Visitor &visitor) const
+{
+    if (mNodes.empty())
+        return;
+    
+    PacketF64 origin[3];
+    PacketF64 invDirection[3];
+    PacketF64 tNear;
+    
+    for (U32 axis = 0; axis < 3; axis++)
+    {
+        origin[axis] = packet.getOrigin(axis);
+        invDirection[axis] = PacketF64(1.0) / packet.getDirection(axis);
+    }
+    
+    mask &= mNodes[0].bounds.intersect(origin, invDirection, PacketF64(distance), tNear);
+    if (!mask)
+        return;
+    
+    U32 stack[MAX_DEPTH];
+    U32 stackMask[MAX_DEPTH];
+    F64 stackDistance[MAX_DEPTH][RayPacket::SIZE];
+    S32 top = 0;
+    U32 index = 0;
+    
+    while (true)
+    {
+        const Node &node = mNodes[index];
+        
+        if (node.isLeaf())
+            visitor(node.offset, node.count, distance, mask);
+        else
+        {
+            U32 nearIndex = index + 1;
+            U32 farIndex = node.offset;
+            PacketF64 maxDistance(distance);
+            PacketF64 tLeft, tRight;
+            U32 hitLeft = mNodes[nearIndex].bounds.intersect(origin, invDirection, maxDistance, tLeft) & mask;
+            U32 hitRight = mNodes[farIndex].bounds.intersect(origin, invDirection, maxDistance, tRight) & mask;
+            
+            if (hitLeft && hitRight)
+            {
+                // Front to back along the first lane that reaches both
+                U32 both = hitLeft & hitRight;
+                bool rightFirst = false;
+                
+                if (both)
+                {
+                    F64 left[RayPacket::SIZE], right[RayPacket::SIZE];
+                    U32 lane = 0;
+                    
+                    tLeft.store(left);
+                    tRight.store(right);
+                    while (!(both & (1 << lane)))
+                        lane++;
+                    rightFirst = right[lane] < left[lane];
+                }
+                
+                if (rightFirst)
+                {
+                    stack[top] = nearIndex;
+                    stackMask[top] = hitLeft;
+                    tLeft.store(stackDistance[top]);
+                    index = farIndex;
+                    mask = hitRight;
+                }
+                else
+                {
+                    stack[top] = farIndex;
+                    stackMask[top] = hitRight;
+                    tRight.store(stackDistance[top]);
+                    index = nearIndex;
+                    mask = hitLeft;
+                }
+                top++;
+                continue;
+            }
+            else if (hitLeft)
+            {
+                index = nearIndex;
+                mask = hitLeft;
+                continue;
+            }
+            else if (hitRight)
+            {
+                index = farIndex;
+                mask = hitRight;
+                continue;
+            }
+        }
+        
+        // Pop the next node that can still hold a closer hit for some lane
+        do
+        {
+            if (top == 0)
+                return;
+            top--;
+            index = stack[top];
+            mask = stackMask[top];
+            
+            for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+            {
+                if (stackDistance[top][lane] > distance[lane])
+                    mask &= ~(1 << lane);
+            }
+        } while (!mask);
+    }
+}
+
+template <class Visitor>
+void BVH::traverse(const Box3D &box, Visitor &visitor) const
+{
+    if (mNodes.empty())
+        return;
+    
+    U32 stack[MAX_DEPTH];
+    S32 top = 0;
+    
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node &node = mNodes[stack[--top]];
+        const Box3D &bounds = node.bounds;
+        
+        if (bounds.minExtents.x > box.maxExtents.x || bounds.maxExtents.x < box.minExtents.x ||
+            bounds.minExtents.y > box.maxExtents.y || bounds.maxExtents.y < box.minExtents.y ||
+            bounds.minExtents.z > box.maxExtents.z || bounds.maxExtents.z < box.minExtents.z)
+            continue;
+        
+        if (node.isLeaf())
+        {
+            if (visitor(node.offset, node.count))
+                return;
+        }
+        else
+        {
+            stack[top++] = node.offset;
+            stack[top++] = (U32) (&node - &mNodes[0]) + 1;
+        }
+    }
+}
+
+#endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "math/math.h"
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 
 Cone::Cone(F64 bottomRadius) //: mCosAngle(cos(angle))
 {
@@ -11,6 +12,7 @@ Cone::Cone(F64 bottomRadius) //: mCosAngle(cos(angle))
     axis.normalize();
     rightEdge.normalize();
     mCosAngle = dot(axis, rightEdge);
+    mHeight = 0.0;
     mDirection.set(0, -1, 0);
     mDirection.normalize();
     mTopPlane = NULL;
@@ -92,6 +94,11 @@ Point3D Cone::getNormal(const Point3D &point) const
 
 SceneObject::IntersectResult Cone::intersect(const Ray& ray, F64 &distance, IntersectionList *list) const
 {
+    F64 lo, hi;
+    
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
+    
     const Point3D &S = ray.getOrigin();
     const Point3D &V = ray.getDirection();
     const Point3D &P = mAnchor;
@@ -114,42 +121,59 @@ SceneObject::IntersectResult Cone::intersect(const Ray& ray, F64 &distance, Inte
         F64 t1 = (-b - sqrtD) / (2 * a);
         F64 t2 = (-b + sqrtD) / (2 * a);
         
-        processIntersection(ray, t1, res, distance, list);
-        processIntersection(ray, t2, res, distance, list);
-        
-        /*if (t1 > EPSILON && t1 < distance && isInsideCutPlane(ray, t1))
-         {
-         distance = t1;
-         res = HIT;
-         }
-         
-         if (t2 > EPSILON && t2 < distance && isInsideCutPlane(ray, t2))
-         {
-         distance = t2;
-         res = HIT;
-         }*/
+        processIntersection(t1, lo, hi, res, distance, list);
+        processIntersection(t2, lo, hi, res, distance, list);
     }
     else if (isZero(D))
     {
         F64 t = -b / (2 * a);
-        processIntersection(ray, t, res, distance, list);
-        /*if (t > 0 && t < distance && isInsideCutPlane(ray, t))
-         {
-         distance = t;
-         res = HIT;
-         }*/
+        processIntersection(t, lo, hi, res, distance, list);
     }
     return res;
 }
 
+bool Cone::getExtent(Box3D &box) const
+{
+    // Same as Cylinder::getExtent but the radius grows with the distance to the
+    // apex, so each nappe gets its own range. s >= 0 runs along mDirection and
+    // s < 0 along the opposite nappe
+    F64 tanAngle = sqrt(1.0 - mCosAngle * mCosAngle) / mCosAngle;
+    F64 lo[2] = { 0.0, 0.0 };
+    F64 hi[2] = { F64_MAX, F64_MAX };
+    
+    for (S32 i = 0; i < getCutPlaneCount(); ++i)
+    {
+        const Plane *plane = getCutPlane(i);
+        Point3D N = plane->getNormal();
+        F64 dNQ = dot(N, mDirection);
+        F64 spread = tanAngle * sqrt(max(1.0 - dNQ * dNQ, 0.0));
+        F64 b = dot(N, plane->getAnchor() - mAnchor);
+        clipInterval(dNQ - spread, b, lo[0], hi[0]);
+        clipInterval(-dNQ - spread, b, lo[1], hi[1]);
+    }
+    
+    box.empty();
+    for (S32 k = 0; k < 2; ++k)
+    {
+        if (lo[k] > hi[k])
+            continue;
+        if (hi[k] >= F64_MAX)
+            return false;
+        
+        Point3D direction = (k == 0)? mDirection : mDirection * -1;
+        box.extendDisk(mAnchor + direction * lo[k], mDirection, lo[k] * tanAngle);
+        box.extendDisk(mAnchor + direction * hi[k], mDirection, hi[k] * tanAngle);
+    }
+    return true;
+}
+
 void Cone::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
 {
-    const BumpMap *bumpMap = getBumpMap();
     Point3D U;
     cross(normal, getNorth(), &U);
     const Point3D &V = mDirection;
-    F32 k1 =  (bumpMap->getHeight(i-1, j) - bumpMap->getHeight(i+1, j)) / 2;
-    F32 k2 =  (bumpMap->getHeight(i, j-1) - bumpMap->getHeight(i, j+1)) / 2;
+    F32 k1, k2;
+    getBumpMap()->getDerivatives().getSlopes(i, j, k1, k2);
     normal = normal + U * k2 + V * k1;
     normal.normalize();
 }
@@ -167,4 +191,27 @@ void Cone::transform(const MatrixD &m)
     if (mBottomPlane)
         mBottomPlane->transform(m);
     Parent::transform(m);
+}
+
+void Cone::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.write(mAnchor);
+    stream.write(mDirection);
+    stream.write(mHeight);
+    stream.write(mCosAngle);
+    writeCutPlane(stream, mTopPlane);
+    writeCutPlane(stream, mBottomPlane);
+}
+
+bool Cone::read(SceneStream &stream)
+{
+    Parent::read(stream);
+    stream.read(&mAnchor);
+    stream.read(&mDirection);
+    stream.read(&mHeight);
+    stream.read(&mCosAngle);
+    mTopPlane = readCutPlane(stream);
+    mBottomPlane = readCutPlane(stream);
+    return stream.isOk();
 }
\ No newline at end of file
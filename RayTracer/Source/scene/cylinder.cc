@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "math/math.h"
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 
 Cylinder::Cylinder(F64 radius) : mHeight(0.0), mRadius(radius)
 {
@@ -91,6 +92,11 @@ Point3D Cylinder::getNormal(const Point3D &point) const
 
 SceneObject::IntersectResult Cylinder::intersect(const Ray& ray, F64 &distance, IntersectionList *list) const
 {
+    F64 lo, hi;
+    
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
+    
     const Point3D &S = ray.getOrigin();
     const Point3D &V = ray.getDirection();
     const Point3D &P = mAnchor;
@@ -117,44 +123,55 @@ SceneObject::IntersectResult Cylinder::intersect(const Ray& ray, F64 &distance,
         F64 t1 = (-b - sqrtD) / (2 * a);
         F64 t2 = (-b + sqrtD) / (2 * a);
         
-        processIntersection(ray, t1, res, distance, list);
-        processIntersection(ray, t2, res, distance, list);
-        
-        /*if (t1 > EPSILON && t1 < distance && isInsideCutPlane(ray, t1))
-         {
-         distance = t1;
-         res = HIT;
-         }
-         
-         if (t2 > EPSILON && t2 < distance && isInsideCutPlane(ray, t2))
-         {
-         distance = t2;
-         res = HIT;
-         }*/
+        processIntersection(t1, lo, hi, res, distance, list);
+        processIntersection(t2, lo, hi, res, distance, list);
     }
     else if (isZero(D))
     {
         F64 t = -b / (2 * a);
-        processIntersection(ray, t, res, distance, list);
-        /*if (t > 0 && t < distance && isInsideCutPlane(ray, t))
-         {
-         distance = t;
-         res = HIT;
-         }*/
+        processIntersection(t, lo, hi, res, distance, list);
     }
     
     return res;
 }
 
+bool Cylinder::getExtent(Box3D &box) const
+{
+    // Find the range of the axis parameter s that the cut planes leave. A point
+    // P + s * Q + r * U (U perpendicular to Q) is kept when
+    // s * dot(N, Q) <= dot(N, A - P) - r * dot(N, U), and the loosest U gives
+    // r * sqrt(1 - dot(N, Q)^2) for the last term
+    F64 lo = -F64_MAX;
+    F64 hi = F64_MAX;
+    
+    for (S32 i = 0; i < getCutPlaneCount(); ++i)
+    {
+        const Plane *plane = getCutPlane(i);
+        Point3D N = plane->getNormal();
+        F64 dNQ = dot(N, mDirection);
+        F64 b = dot(N, plane->getAnchor() - mAnchor) + mRadius * sqrt(max(1.0 - dNQ * dNQ, 0.0));
+        clipInterval(dNQ, b, lo, hi);
+    }
+    
+    box.empty();
+    if (lo > hi)
+        return true;
+    if (lo <= -F64_MAX || hi >= F64_MAX)
+        return false;
+    
+    box.extendDisk(mAnchor + mDirection * lo, mDirection, mRadius);
+    box.extendDisk(mAnchor + mDirection * hi, mDirection, mRadius);
+    return true;
+}
+
 void Cylinder::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
 {
-    const BumpMap *bumpMap = getBumpMap();
     const Point3D &Q = mDirection;
     Point3D U;
     cross(Q, normal, &U);
     const Point3D &V = Q;
-    F32 k1 =  (bumpMap->getHeight(i-1, j) - bumpMap->getHeight(i+1, j)) / 2;
-    F32 k2 =  (bumpMap->getHeight(i, j-1) - bumpMap->getHeight(i, j+1)) / 2;
+    F32 k1, k2;
+    getBumpMap()->getDerivatives().getSlopes(i, j, k1, k2);
     normal = normal + U * k2 + V * k1;
     normal.normalize();
 }
@@ -172,4 +189,29 @@ void Cylinder::transform(const MatrixD &m)
     if (mBottomPlane)
         mBottomPlane->transform(m);
     Parent::transform(m);
+}
+
+void Cylinder::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.write(mAnchor);
+    stream.write(mDirection);
+    stream.write(mHeight);
+    stream.write(mRadius);
+    stream.write(mSquaredRadius);
+    writeCutPlane(stream, mTopPlane);
+    writeCutPlane(stream, mBottomPlane);
+}
+
+bool Cylinder::read(SceneStream &stream)
+{
+    Parent::read(stream);
+    stream.read(&mAnchor);
+    stream.read(&mDirection);
+    stream.read(&mHeight);
+    stream.read(&mRadius);
+    stream.read(&mSquaredRadius);
+    mTopPlane = readCutPlane(stream);
+    mBottomPlane = readCutPlane(stream);
+    return stream.isOk();
 }
\ No newline at end of file
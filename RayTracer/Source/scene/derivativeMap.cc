@@ -0,0 +1,36 @@
+#include "scene/scene.h"
+
+DerivativeMap::DerivativeMap() : mWidth(0), mSlopes(NULL)
+{
+}
+
+DerivativeMap::~DerivativeMap()
+{
+    if (mSlopes)
+        delete[] mSlopes;
+}
+
+void DerivativeMap::init(const BumpMap &bumpMap)
+{
+    if (mSlopes)
+        delete[] mSlopes;
+    
+    mWidth = bumpMap.width;
+    mSlopes = new F32[2 * bumpMap.width * bumpMap.height];
+    
+    // Central differences with the neighbours outside the map clamped to its
+    // edge. i - 1 and j - 1 are clamped here, getHeight() takes U32 and would
+    // wrap them around to the last column and row
+    for (U32 j = 0; j < bumpMap.height; j++)
+    {
+        U32 up = (j > 0)? j - 1 : 0;
+        
+        for (U32 i = 0; i < bumpMap.width; i++)
+        {
+            U32 left = (i > 0)? i - 1 : 0;
+            F32 *slopes = mSlopes + 2 * (j * mWidth + i);
+            slopes[0] = (bumpMap.getHeight(left, j) - bumpMap.getHeight(i+1, j)) / 2;
+            slopes[1] = (bumpMap.getHeight(i, up) - bumpMap.getHeight(i, j+1)) / 2;
+        }
+    }
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "math/math.h"
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 
 Disk::Disk(F64 radius, bool anti) :
     mPlane(Point3D(0.0, 0.0, 0.0), Point3D(0.0, 0.0, -1.0)),
@@ -111,10 +112,15 @@ Point3D Disk::getNormal(const Point3D &point) const
 
 SceneObject::IntersectResult Disk::intersect(const Ray& ray, F64 &distance, IntersectionList *list) const
 {
-    F64 t = distance;
+    F64 lo, hi;
+    
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
+    
+    F64 t = min(distance, hi);
     SceneObject::IntersectResult intersectsPlane = mPlane.intersect(ray, t);
     
-    if (intersectsPlane)
+    if (intersectsPlane && t > lo)
     {
         const Point3D &S = ray.getOrigin();
         const Point3D &V = ray.getDirection();
@@ -124,7 +130,7 @@ SceneObject::IntersectResult Disk::intersect(const Ray& ray, F64 &distance, Inte
         F64 f2 = pow(ip.x - C.x, 2) + pow(ip.y - C.y, 2) + pow(ip.z - C.z, 2) - mSquaredRadius;
         bool intersects = (mAnti)? f1 >= EPSILON : f1 <= EPSILON /*&& f2 > EPSILON*/;
         
-        if (intersects && isInsideCutPlane(ray, t))
+        if (intersects)
         {
             if (list)
                 list->add(this, t);
@@ -135,6 +141,57 @@ SceneObject::IntersectResult Disk::intersect(const Ray& ray, F64 &distance, Inte
     return MISS;
 }
 
+// Same operations in the same order as intersect(), lane by lane
+U32 Disk::intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const
+{
+    F64 lo[RayPacket::SIZE], hi[RayPacket::SIZE], t[RayPacket::SIZE];
+    
+    mask = clipToCutPlanes(packet, mask, lo, hi);
+    if (!mask)
+        return 0;
+    
+    for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+        t[lane] = min(distance[lane], hi[lane]);
+    
+    U32 hits = mPlane.intersectPacket(packet, t, mask);
+    
+    if (!hits)
+        return 0;
+    
+    const Point3D &C = mPlane.getAnchor();
+    PacketF64 T(t);
+    PacketF64 dx = (packet.getOrigin(0) + packet.getDirection(0) * T) - PacketF64(C.x);
+    PacketF64 dy = (packet.getOrigin(1) + packet.getDirection(1) * T) - PacketF64(C.y);
+    PacketF64 dz = (packet.getOrigin(2) + packet.getDirection(2) * T) - PacketF64(C.z);
+    PacketF64 f1 = dx * dx + dy * dy + dz * dz - PacketF64(mSquaredRadius);
+    
+    hits &= ((mAnti)? f1 >= PacketF64(EPSILON) : f1 <= PacketF64(EPSILON)).getBits();
+    
+    for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+    {
+        if (!(hits & (1 << lane)))
+            continue;
+        
+        if (t[lane] > lo[lane])
+            distance[lane] = t[lane];
+        else
+            hits &= ~(1 << lane);
+    }
+    return hits;
+}
+
+bool Disk::getExtent(Box3D &box) const
+{
+    // An anti-disk covers the whole plane but the hole, only the texture
+    // rectangle from setBounds() limits it
+    if (mAnti)
+        return mTexturePoly && mTexturePoly->getBounds(box);
+    
+    box.empty();
+    box.extendDisk(mPlane.getAnchor(), mPlane.getNormal(), mRadius);
+    return true;
+}
+
 void Disk::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
 {
     mTexturePoly->perturbNormal(normal, i, j);
@@ -154,4 +211,54 @@ void Disk::transformUV(const MatrixD &m)
 {
     if (mTexturePoly)
         mTexturePoly->transformUV(m);
+}
+
+void Disk::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.write(mPlane.getAnchor());
+    stream.write(mPlane.getNormal());
+    stream.write(mRadius);
+    stream.write(mSquaredRadius);
+    stream.write(mAnti);
+    stream.write(mWidthLeft);
+    stream.write(mWidthRight);
+    stream.write(mHeightTop);
+    stream.write(mHeightBottom);
+    
+    for (U32 i = 0; i < 4; i++)
+        writeCutPlane(stream, mCutPlanes[i]);
+    
+    stream.write(mTexturePoly != NULL);
+    if (mTexturePoly)
+        mTexturePoly->write(stream);
+}
+
+bool Disk::read(SceneStream &stream)
+{
+    Point3D anchor, normal;
+    bool hasTexturePoly = false;
+    
+    Parent::read(stream);
+    stream.read(&anchor);
+    stream.read(&normal);
+    mPlane = Plane(anchor, normal);
+    stream.read(&mRadius);
+    stream.read(&mSquaredRadius);
+    stream.read(&mAnti);
+    stream.read(&mWidthLeft);
+    stream.read(&mWidthRight);
+    stream.read(&mHeightTop);
+    stream.read(&mHeightBottom);
+    
+    for (U32 i = 0; i < 4; i++)
+        mCutPlanes[i] = readCutPlane(stream);
+    
+    stream.read(&hasTexturePoly);
+    if (hasTexturePoly && stream.isOk())
+    {
+        mTexturePoly = new PolygonD();
+        mTexturePoly->read(stream);
+    }
+    return stream.isOk();
 }
\ No newline at end of file
@@ -27,6 +27,7 @@ public:
     F32 getIntensity() const { return mIntensity; }
     const Point3D& getLocation() const { return mLocation; }
     void setAttenuationConstants(F32 c1, F32 c2, F32 c3) { mC1 = c1; mC2 = c2; mC3 = c3; }
+    void getAttenuationConstants(F32 &c1, F32 &c2, F32 &c3) const { c1 = mC1; c2 = mC2; c3 = mC3; }
     F32 getAttenuationFactor(F32 distance) const { return min(1 / (mC1 + mC2 * distance + mC3 * (distance * distance)), 1.0f); }
 private:
     F32 mIntensity;
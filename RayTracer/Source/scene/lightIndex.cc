@@ -0,0 +1,115 @@
+#include "scene/lightIndex.h"
+#include "scene/light.h"
+
+LightIndex::LightIndex() : mSize(0)
+{
+}
+
+F32 LightIndex::getRange(const PointLight &light, F32 threshold)
+{
+    F32 c1, c2, c3;
+    light.getAttenuationConstants(c1, c2, c3);
+    
+    // Solve intensity / (c1 + c2 * d + c3 * d^2) = threshold
+    F32 k = light.getIntensity() / threshold;
+    
+    if (k <= c1)
+        return 0.0f;
+    
+    if (c3 > 0.0f)
+        return (-c2 + sqrt(c2 * c2 + 4 * c3 * (k - c1))) / (2 * c3);
+    else if (c2 > 0.0f)
+        return (k - c1) / c2;
+    else
+        return F32_MAX;
+}
+
+void LightIndex::clear()
+{
+    mBounds.empty();
+    mSize = 0;
+    mCells.clear();
+    mUnbounded.clear();
+    mRanges.clear();
+}
+
+void LightIndex::build(const std::vector<PointLight*> &lights)
+{
+    U32 bounded = 0;
+    
+    clear();
+    for (U32 k = 0; k < lights.size(); k++)
+    {
+        F32 range = getRange(*lights[k], LIGHT_THRESHOLD);
+        const Point3D &location = lights[k]->getLocation();
+        
+        mRanges.push_back(range);
+        if (range == F32_MAX)
+            mUnbounded.push_back(k);
+        else if (range > 0.0f)
+        {
+            Point3D extent(range, range, range);
+            mBounds.extend(Box3D(location - extent, location + extent));
+            bounded++;
+        }
+    }
+    
+    if (bounded == 0)
+        return;
+    
+    // About one light per cell when they are spread out
+    mSize = 1;
+    while (mSize * mSize * mSize < bounded && mSize < MAX_CELLS)
+        mSize++;
+    mSize = min(mSize * 2, (U32) MAX_CELLS);
+    
+    Point3D cellSize = (mBounds.maxExtents - mBounds.minExtents) / Real(mSize);
+    mInvCellSize.set(1 / cellSize.x, 1 / cellSize.y, 1 / cellSize.z);
+    mCells.resize(mSize * mSize * mSize, mUnbounded);
+    
+    for (U32 k = 0; k < lights.size(); k++)
+    {
+        if (mRanges[k] == F32_MAX || mRanges[k] == 0.0f)
+            continue;
+        
+        const Point3D &location = lights[k]->getLocation();
+        F64 squaredRange = F64(mRanges[k]) * mRanges[k];
+        
+        for (U32 z = 0; z < mSize; z++)
+        {
+            for (U32 y = 0; y < mSize; y++)
+            {
+                for (U32 x = 0; x < mSize; x++)
+                {
+                    Point3D cellMin(mBounds.minExtents.x + cellSize.x * x,
+                                    mBounds.minExtents.y + cellSize.y * y,
+                                    mBounds.minExtents.z + cellSize.z * z);
+                    Point3D cellMax = cellMin + cellSize;
+                    
+                    // Distance from the light to the closest point of the cell
+                    Point3D closest(max(cellMin.x, min(location.x, cellMax.x)),
+                                    max(cellMin.y, min(location.y, cellMax.y)),
+                                    max(cellMin.z, min(location.z, cellMax.z)));
+                    Point3D D = location - closest;
+                    
+                    if (dot(D, D) <= squaredRange)
+                        mCells[(z * mSize + y) * mSize + x].push_back(k);
+                }
+            }
+        }
+    }
+}
+
+const std::vector<U32>& LightIndex::find(const Point3D &point) const
+{
+    if (mSize == 0 ||
+        point.x < mBounds.minExtents.x || point.x > mBounds.maxExtents.x ||
+        point.y < mBounds.minExtents.y || point.y > mBounds.maxExtents.y ||
+        point.z < mBounds.minExtents.z || point.z > mBounds.maxExtents.z)
+        return mUnbounded;
+    
+    U32 x = min(U32((point.x - mBounds.minExtents.x) * mInvCellSize.x), mSize - 1);
+    U32 y = min(U32((point.y - mBounds.minExtents.y) * mInvCellSize.y), mSize - 1);
+    U32 z = min(U32((point.z - mBounds.minExtents.z) * mInvCellSize.z), mSize - 1);
+    return mCells[(z * mSize + y) * mSize + x];
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef _LIGHTINDEX_H_
+#define _LIGHTINDEX_H_
+
+#include <vector>
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+#include "math/math.h"
+
+class PointLight;
+
+// Intensity times attenuation below which a light is left out. Half of one
+// 8-bit step, the diffuse and specular terms together can double it
+#define LIGHT_THRESHOLD (1.0f / 512.0f)
+
+// Uniform grid over the spheres of influence of the point lights. A light
+// reaches as far as its attenuated intensity stays above LIGHT_THRESHOLD,
+// lights without attenuation reach everywhere and are in every cell.
+class LightIndex
+{
+public:
+    enum { MAX_CELLS = 16 };   // Per axis
+    
+    LightIndex();
+    
+    void build(const std::vector<PointLight*> &lights);
+    void clear();
+    
+    // Lights that may reach point, by their index in the scene. Holds every
+    // light within range of point and possibly a few more
+    const std::vector<U32>& find(const Point3D &point) const;
+    // Distance past which a light adds nothing, F32_MAX for lights that reach
+    // everywhere
+    F32 getRange(U32 light) const { return mRanges[light]; }
+    
+    static F32 getRange(const PointLight &light, F32 threshold);
+    
+private:
+    Box3D mBounds;
+    Point3D mInvCellSize;
+    U32 mSize;
+    std::vector< std::vector<U32> > mCells;
+    // Lights found outside the grid
+    std::vector<U32> mUnbounded;
+    std::vector<F32> mRanges;
+};
+
+#endif
\ No newline at end of file
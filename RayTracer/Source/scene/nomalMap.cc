@@ -1,3 +1,4 @@
+#include "core/memStream.h"
 #include "scene/scene.h"
 #include <assert.h>
 
@@ -8,19 +9,18 @@ NormalMap::NormalMap() : mNormals(NULL)
 NormalMap::~NormalMap()
 {
     if (mNormals)
-        free(mNormals);
+        delete[] mNormals;
 }
 
 void NormalMap::init(Texture *texture)
 {
     if (mNormals)
-        free(mNormals);
+        delete[] mNormals;
     
     width = texture->bitmap.width;
     height = texture->bitmap.height;
-    U32 size = width * height * sizeof(Point3D);
-    mNormals = new Point3D[size];
-    memset(mNormals, 0, size);
+    mNormals = new U32[width * height];
+    memset(mNormals, 0, width * height * sizeof(U32));
     ColorF c;
     Point3D normal;
     
@@ -62,3 +62,21 @@ void NormalMap::init(Texture *texture)
         }
     }
 }
+
+void NormalMap::write(MemStream &stream) const
+{
+    Map::write(stream);
+    stream.write(width * height * sizeof(U32), mNormals);
+}
+
+bool NormalMap::read(MemStream &stream)
+{
+    if (!Map::read(stream) || U64(width) * height * sizeof(U32) > stream.getRemaining())
+    {
+        stream.fail();
+        return false;
+    }
+    
+    mNormals = new U32[width * height];
+    return stream.read(width * height * sizeof(U32), mNormals);
+}
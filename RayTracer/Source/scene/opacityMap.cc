@@ -1,25 +1,30 @@
+#include "core/memStream.h"
 #include "scene/scene.h"
 
-OpacityMap::OpacityMap() : mFlags(NULL)
+OpacityMap::OpacityMap() : mFlags(NULL), mBlocks(NULL), mBlockWidth(0), mCoverage(EMPTY)
 {
 }
 
 OpacityMap::~OpacityMap()
 {
     if (mFlags)
-        free(mFlags);
+        delete[] mFlags;
+    if (mBlocks)
+        delete[] mBlocks;
 }
 
 void OpacityMap::init(Texture *texture, F32 tolerance)
 {
     if (mFlags)
-        free(mFlags);
+        delete[] mFlags;
+    if (mBlocks)
+        delete[] mBlocks;
+    mBlocks = NULL;
     
     width = texture->bitmap.width;
     height = texture->bitmap.height;
-    U32 size = width * height * sizeof(U8);
-    mFlags = new U8[size];
-    memset(mFlags, 0, size);
+    mFlags = new U32[getWordCount()];
+    memset(mFlags, 0, getWordCount() * sizeof(U32));
     ColorF c;
     //Point3D p;
     
@@ -31,4 +36,66 @@ void OpacityMap::init(Texture *texture, F32 tolerance)
             setFlag(i, j, c.alpha > 0.0);
         }
     }
+    buildCoverage();
 }
+
+void OpacityMap::buildCoverage()
+{
+    U32 size = 1 << BLOCK_SHIFT;
+    U32 blockHeight = (height + size - 1) >> BLOCK_SHIFT;
+    bool opaque = false;
+    bool empty = false;
+    
+    if (mBlocks)
+        delete[] mBlocks;
+    mBlockWidth = (width + size - 1) >> BLOCK_SHIFT;
+    mBlocks = new U8[mBlockWidth * blockHeight];
+    
+    for (U32 bj = 0; bj < blockHeight; bj++)
+    {
+        for (U32 bi = 0; bi < mBlockWidth; bi++)
+        {
+            U32 count = 0;
+            U32 set = 0;
+            
+            for (U32 j = bj * size; j < min((bj + 1) * size, height); j++)
+            {
+                for (U32 i = bi * size; i < min((bi + 1) * size, width); i++)
+                {
+                    if (getBit(j * width + i))
+                        set++;
+                    count++;
+                }
+            }
+            
+            U8 coverage = (set == 0)? EMPTY : ((set == count)? OPAQUE : MIXED);
+            mBlocks[bj * mBlockWidth + bi] = coverage;
+            opaque = opaque || coverage != EMPTY;
+            empty = empty || coverage != OPAQUE;
+        }
+    }
+    mCoverage = (opaque && empty)? MIXED : ((opaque)? OPAQUE : EMPTY);
+}
+
+void OpacityMap::write(MemStream &stream) const
+{
+    Map::write(stream);
+    stream.write(getWordCount() * sizeof(U32), mFlags);
+}
+
+bool OpacityMap::read(MemStream &stream)
+{
+    if (!Map::read(stream) || (U64(width) * height + 31) / 32 * sizeof(U32) > stream.getRemaining())
+    {
+        stream.fail();
+        return false;
+    }
+    
+    mFlags = new U32[getWordCount()];
+    
+    if (!stream.read(getWordCount() * sizeof(U32), mFlags))
+        return false;
+    
+    buildCoverage();
+    return true;
+}
\ No newline at end of file
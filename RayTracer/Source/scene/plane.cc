@@ -1,20 +1,11 @@
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 
 Plane::Plane(const Point3D &anchor, const Point3D &normal) : mAnchor(anchor), mNormal(normal)
 {
     //
 }
 
-Point3D Plane::getAnchor() const
-{
-    return mAnchor;
-}
-
-Point3D Plane::getNormal() const
-{
-    return mNormal;
-}
-
 Point3D Plane::getNormal(const Point3D &point) const
 {
     return getNormal();
@@ -59,6 +50,34 @@ SceneObject::IntersectResult Plane::intersect(const Ray& ray, F64 &distance, Int
     return res;
 }
 
+// Same operations in the same order as intersect(), lane by lane
+U32 Plane::intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const
+{
+    const Point3D &P = mAnchor;
+    const Point3D &N = mNormal;
+    PacketF64 Nx(N.x), Ny(N.y), Nz(N.z);
+    
+    PacketF64 D(-dot(N, P));
+    PacketF64 dNV = Nx * packet.getDirection(0) + Ny * packet.getDirection(1) + Nz * packet.getDirection(2);
+    PacketF64 t = -(Nx * packet.getOrigin(0) + Ny * packet.getOrigin(1) + Nz * packet.getOrigin(2) + D) / dNV;
+    
+    PacketMask valid = (dNV > PacketF64(EPSILON)) | (dNV < PacketF64(-EPSILON));
+    U32 hits = (valid & (t > PacketF64(EPSILON)) & (t < PacketF64(distance))).getBits() & mask;
+    
+    if (hits)
+    {
+        F64 values[RayPacket::SIZE];
+        
+        t.store(values);
+        for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+        {
+            if (hits & (1 << lane))
+                distance[lane] = values[lane];
+        }
+    }
+    return hits;
+}
+
 void Plane::transform(const MatrixD &m)
 {
     Point3D point = mAnchor + mNormal * 2;
@@ -67,3 +86,18 @@ void Plane::transform(const MatrixD &m)
     mNormal = point - mAnchor;
     mNormal.normalize();
 }
+
+void Plane::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.write(mAnchor);
+    stream.write(mNormal);
+}
+
+bool Plane::read(SceneStream &stream)
+{
+    Parent::read(stream);
+    stream.read(&mAnchor);
+    stream.read(&mNormal);
+    return stream.isOk();
+}
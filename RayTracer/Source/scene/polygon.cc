@@ -1,5 +1,6 @@
 #include <assert.h>
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 
 PolygonD::PolygonD() : mPlane(NULL), mDropCoord(NONE)
 {
@@ -20,14 +21,6 @@ PolygonD::~PolygonD()
         mVertexList.pop_back();
         delete vertex;
     }
-    
-    while (!mUVVertexList.empty())
-    {
-        PointUV *vertex = mUVVertexList.back();
-        mUVVertexList.pop_back();
-        delete vertex;
-    }
-    
 }
 
 // Fix me: move texture initialization somewhere else
@@ -35,10 +28,10 @@ void PolygonD::addVertex(const Point3D &vertex)
 {
     assert(vertex.z == 0.0);
     mVertexList.push_back(new Point3D(vertex.x, vertex.y, vertex.z));
-    mMaxX = max(mMaxX, vertex.x);
-    mMinX = min(mMinX, vertex.x);
-    mMaxY = max(mMaxY, vertex.y);
-    mMinY = min(mMinY, vertex.y);
+    mMaxX = max(mMaxX, (F64) vertex.x);
+    mMinX = min(mMinX, (F64) vertex.x);
+    mMaxY = max(mMaxY, (F64) vertex.y);
+    mMinY = min(mMinY, (F64) vertex.y);
 }
 
 void PolygonD::preInitialize()
@@ -105,12 +98,62 @@ void PolygonD::project()
     
     for (std::vector<Point3D*>::const_iterator walk = mVertexList.begin(); walk != mVertexList.end(); walk++)
     {
-        Point3D *point = *walk;
-        PointUV *uvPoint = new PointUV();
+        PointUV uvPoint;
         
-        projectPoint(*point, uvPoint);
+        projectPoint(**walk, &uvPoint);
         mUVVertexList.push_back(uvPoint);
     }
+    prepareEdges();
+}
+
+void PolygonD::prepareEdges()
+{
+    U32 count = (U32) mUVVertexList.size();
+    F64 area = 0.0;
+    
+    mEdges.clear();
+    if (count < 3)
+        return;
+    
+    for (U32 i = 0; i < count; i++)
+    {
+        const PointUV &p1 = mUVVertexList[i];
+        const PointUV &p2 = mUVVertexList[(i + 1) % count];
+        Edge edge;
+        
+        edge.a = p1.v - p2.v;
+        edge.b = p2.u - p1.u;
+        edge.c = -(edge.a * p1.u + edge.b * p1.v);
+        mEdges.push_back(edge);
+        area += p1.u * p2.v - p2.u * p1.v;
+    }
+    
+    // Clockwise outlines are turned counterclockwise
+    if (area < 0.0)
+    {
+        for (std::vector<Edge>::iterator walk = mEdges.begin(); walk != mEdges.end(); walk++)
+        {
+            walk->a = -walk->a;
+            walk->b = -walk->b;
+            walk->c = -walk->c;
+        }
+    }
+}
+
+bool PolygonD::isInside(const PointUV &point) const
+{
+    U32 count = (U32) mEdges.size();
+    
+    if (count == 0)
+        return false;
+    
+    // No branch, every edge function has to be positive
+    const Edge *edge = &mEdges[0];
+    U32 inside = 1;
+    
+    for (U32 i = 0; i < count; i++)
+        inside &= (edge[i].a * point.u + edge[i].b * point.v + edge[i].c >= 0.0);
+    return inside != 0;
 }
 
 inline void PolygonD::projectPoint(const Point3D &point, PointUV *uvPoint) const
@@ -149,63 +192,24 @@ Point3D PolygonD::getNormal(const Point3D &point) const
     return mPlane->getNormal();
 }
 
-// Translates the given point p to the origin. The origin is according the intersection point ip
-static inline PointUV translate(const PointUV &p, const PointUV &ip)
-{
-    return p - ip;
-}
-
-static bool intersectsEdge(const PointUV &p1, const PointUV &p2)
+SceneObject::IntersectResult PolygonD::intersect(const Ray& ray, F64 &distance, IntersectionList *list) const
 {
-    if (p1.v >= 0.0 && p2.v >= 0.0
-        || p1.v < 0.0 && p2.v < 0.0
-        || p1.u < 0.0 && p2.u < 0.0)
-    {
-        return false;
-    }
-    
-    // vertical line
-    if (p1.u == p2.u && p1.u == 0.0)
-        return (p1.v < 0.0) ^ (p2.v < 0.0);
+    F64 lo, hi;
     
-    // horizontal line
-    if (p1.v == p2.v && p1.v == 0.0)
-        return (p1.u < 0.0) ^ (p2.u < 0.0);
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
     
-    if ((p1.u >= 0.0 && p2.u >= 0.0) && ((p1.v < 0.0) ^ (p2.v < 0.0)))
-        return true;
-    
-    F64 m = (p2.v - p1.v) / (p2.u - p1.u);
-    // y = 0.0
-    F64 x = p2.u - p2.v / m;
-    return (x >= 0.0);
-}
-
-SceneObject::IntersectResult PolygonD::intersect(const Ray& ray, F64 &distance, IntersectionList *list) const
-{
-    F64 t = distance;
+    F64 t = min(distance, hi);
     SceneObject::IntersectResult intersectsPlane = mPlane->intersect(ray, t);
     
-    if (intersectsPlane)
+    if (intersectsPlane && t > lo)
     {
         const Point3D &S = ray.getOrigin();
         const Point3D &V = ray.getDirection();
         PointUV ip;
-        S32 n = 0;
         
         projectPoint(S + V * t, &ip);
-        std::vector<PointUV*>::const_iterator walk = mUVVertexList.begin();
-        for (; walk != mUVVertexList.end() - 1; )
-        {
-            if (intersectsEdge(translate(**walk, ip), translate(**(walk+1), ip)))
-                n++;
-            walk++;
-        }
-        
-        if (intersectsEdge(translate(*mUVVertexList.back(), ip), translate(*mUVVertexList.front(), ip)))
-            n++;
-        
-        if (n % 2 && isInsideCutPlane(ray, t))
+        if (isInside(ip))
         {
             if (list)
                 list->add(this, t);
@@ -216,11 +220,18 @@ SceneObject::IntersectResult PolygonD::intersect(const Ray& ray, F64 &distance,
     return MISS;
 }
 
+bool PolygonD::getExtent(Box3D &box) const
+{
+    box.empty();
+    for (std::vector<Point3D*>::const_iterator walk = mVertexList.begin(); walk != mVertexList.end(); walk++)
+        box.extend(**walk);
+    return !box.isEmpty();
+}
+
 void PolygonD::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
 {
-    const BumpMap *bumpMap = getBumpMap();
-    F32 k1 =  (bumpMap->getHeight(i-1, j) - bumpMap->getHeight(i+1, j)) / 2;
-    F32 k2 =  (bumpMap->getHeight(i, j-1) - bumpMap->getHeight(i, j+1)) / 2;
+    F32 k1, k2;
+    getBumpMap()->getDerivatives().getSlopes(i, j, k1, k2);
     normal = normal + U * k2 * 8 + V * k1 * 8;
     normal.normalize();
 }
@@ -239,4 +250,84 @@ void PolygonD::transformUV(const MatrixD &m)
     Parent::transformUV(m);
     m.mul(U);
     m.mul(V);
+}
+
+void PolygonD::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.write((U32) mDropCoord);
+    
+    stream.write((U32) mVertexList.size());
+    for (std::vector<Point3D*>::const_iterator walk = mVertexList.begin(); walk != mVertexList.end(); walk++)
+        stream.write(**walk);
+    
+    stream.write((U32) mUVVertexList.size());
+    for (std::vector<PointUV>::const_iterator walk = mUVVertexList.begin(); walk != mUVVertexList.end(); walk++)
+        stream.write(*walk);
+    
+    stream.write(mPlane != NULL);
+    if (mPlane)
+    {
+        stream.write(mPlane->getAnchor());
+        stream.write(mPlane->getNormal());
+    }
+    
+    stream.write(mMaxX);
+    stream.write(mMinX);
+    stream.write(mMaxY);
+    stream.write(mMinY);
+    stream.write(mPoint0);
+    stream.write(U);
+    stream.write(V);
+    stream.write(mWidth);
+    stream.write(mHeight);
+}
+
+bool PolygonD::read(SceneStream &stream)
+{
+    U32 dropCoord = NONE;
+    U32 count = 0;
+    bool hasPlane = false;
+    
+    Parent::read(stream);
+    stream.read(&dropCoord);
+    mDropCoord = (DropCoord) dropCoord;
+    
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.isOk(); i++)
+    {
+        Point3D vertex;
+        if (stream.read(&vertex))
+            mVertexList.push_back(new Point3D(vertex));
+    }
+    
+    count = 0;
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.isOk(); i++)
+    {
+        PointUV vertex;
+        if (stream.read(&vertex))
+            mUVVertexList.push_back(vertex);
+    }
+    prepareEdges();
+    
+    stream.read(&hasPlane);
+    if (hasPlane && stream.isOk())
+    {
+        Point3D anchor, normal;
+        stream.read(&anchor);
+        stream.read(&normal);
+        mPlane = new Plane(anchor, normal);
+    }
+    
+    stream.read(&mMaxX);
+    stream.read(&mMinX);
+    stream.read(&mMaxY);
+    stream.read(&mMinY);
+    stream.read(&mPoint0);
+    stream.read(&U);
+    stream.read(&V);
+    stream.read(&mWidth);
+    stream.read(&mHeight);
+    return stream.isOk();
 }
\ No newline at end of file
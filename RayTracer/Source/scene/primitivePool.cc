@@ -0,0 +1,110 @@
+#include "math/math.h"
+#include "scene/primitivePool.h"
+#include "scene/scene.h"
+
+void PrimitivePool::SphereArray::add(const Sphere &sphere)
+{
+    centerX.push_back(sphere.mCenter.x);
+    centerY.push_back(sphere.mCenter.y);
+    centerZ.push_back(sphere.mCenter.z);
+    centerDot.push_back(dot(sphere.mCenter, sphere.mCenter));
+    squaredRadius.push_back(sphere.mSquaredRadius);
+}
+
+void PrimitivePool::SphereArray::clear()
+{
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    centerDot.clear();
+    squaredRadius.clear();
+}
+
+void PrimitivePool::addTriangle(const Triangle &triangle)
+{
+    const Point3D *table = triangle.mVertexTable;
+    
+    mTriangles.add(table[triangle.mP0Index], table[triangle.mP1Index], table[triangle.mP2Index]);
+}
+
+void PrimitivePool::DiskArray::add(const Disk &disk)
+{
+    Point3D N = disk.mPlane.getNormal();
+    Point3D C = disk.mPlane.getAnchor();
+    
+    normalX.push_back(N.x);
+    normalY.push_back(N.y);
+    normalZ.push_back(N.z);
+    planeD.push_back(-dot(N, C));
+    centerX.push_back(C.x);
+    centerY.push_back(C.y);
+    centerZ.push_back(C.z);
+    squaredRadius.push_back(disk.mSquaredRadius);
+    anti.push_back((disk.mAnti)? 1 : 0);
+}
+
+void PrimitivePool::DiskArray::clear()
+{
+    normalX.clear();
+    normalY.clear();
+    normalZ.clear();
+    planeD.clear();
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    squaredRadius.clear();
+    anti.clear();
+}
+
+void PrimitivePool::clear()
+{
+    mObjects.clear();
+    mKinds.clear();
+    mSlots.clear();
+    mSpheres.clear();
+    mTriangles.clear();
+    mDisks.clear();
+}
+
+void PrimitivePool::build(const std::vector<const SceneObject*> &objects)
+{
+    clear();
+    mObjects = objects;
+    mKinds.reserve(objects.size());
+    mSlots.reserve(objects.size());
+    
+    for (std::vector<const SceneObject*>::const_iterator walk = objects.begin(); walk != objects.end(); walk++)
+    {
+        const SceneObject *object = *walk;
+        
+        // Cut planes and alpha tests are done by the objects themselves, those stay
+        // out of the pools
+        switch ((object->getCutPlaneCount() == 0 && !object->getOpacityMap())? object->getType() : SceneObject::TYPE_COUNT)
+        {
+            case SceneObject::SPHERE:
+                mKinds.push_back(SPHERES);
+                mSlots.push_back((U32) mSpheres.squaredRadius.size());
+                mSpheres.add(*static_cast<const Sphere*>(object));
+                break;
+            case SceneObject::TRIANGLE:
+                mKinds.push_back(TRIANGLES);
+                mSlots.push_back(mTriangles.getCount());
+                addTriangle(*static_cast<const Triangle*>(object));
+                break;
+            case SceneObject::DISK:
+                mKinds.push_back(DISKS);
+                mSlots.push_back((U32) mDisks.planeD.size());
+                mDisks.add(*static_cast<const Disk*>(object));
+                break;
+            default:
+                mKinds.push_back(OBJECTS);
+                mSlots.push_back(0);
+                break;
+        }
+    }
+}
+
+bool PrimitivePool::intersectObject(U32 index, const Ray &ray, F64 &distance) const
+{
+    return mObjects[index]->intersectOpaque(ray, distance) == SceneObject::HIT;
+}
\ No newline at end of file
@@ -0,0 +1,249 @@
+#ifndef _PRIMITIVEPOOL_H_
+#define _PRIMITIVEPOOL_H_
+
+#include <vector>
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+#include "math/math.h"
+
+#ifndef _TRIANGLE_H_
+#include "scene/triangle.h"
+#endif
+
+class SceneObject;
+class Sphere;
+class Triangle;
+class Disk;
+
+// Geometry of the BVH objects copied by type into structure of arrays pools,
+// in the BVH object order. Leaves keep their objects grouped by type, so the
+// spheres, triangles and disks of a leaf are each tested by a tight loop over
+// contiguous arrays instead of a virtual call per object. The SceneObjects are
+// still kept for shading and for every type without a pool.
+class PrimitivePool
+{
+public:
+    enum Kind { SPHERES = 0, TRIANGLES, DISKS, OBJECTS };
+    
+    void build(const std::vector<const SceneObject*> &objects);
+    void clear();
+    
+    U32 getCount() const { return (U32) mObjects.size(); }
+    const SceneObject* getObject(U32 index) const { return mObjects[index]; }
+    
+    // Closest hit among the objects [first, first + count) closer than distance,
+    // same results as SceneObject::intersectOpaque(). handler.hit(object) is
+    // called for every hit, distance is already updated
+    template <class Handler>
+    void intersect(const Ray &ray, U32 first, U32 count, F64 &distance, Handler &handler) const;
+    
+private:
+    // Virtual intersectOpaque() of the objects without a pool
+    bool intersectObject(U32 index, const Ray &ray, F64 &distance) const;
+    void addTriangle(const Triangle &triangle);
+    
+    class SphereArray
+    {
+    public:
+        void add(const Sphere &sphere);
+        void clear();
+        
+        std::vector<F64> centerX, centerY, centerZ;
+        std::vector<F64> centerDot;
+        std::vector<F64> squaredRadius;
+    };
+    
+    class DiskArray
+    {
+    public:
+        void add(const Disk &disk);
+        void clear();
+        
+        std::vector<F64> normalX, normalY, normalZ, planeD;
+        std::vector<F64> centerX, centerY, centerZ;
+        std::vector<F64> squaredRadius;
+        std::vector<U8> anti;
+    };
+    
+    template <class Handler>
+    void intersectSpheres(const Ray &ray, U32 first, U32 slot, U32 count, F64 &distance, Handler &handler) const;
+    template <class Handler>
+    void intersectTriangles(const Ray &ray, U32 first, U32 slot, U32 count, F64 &distance, Handler &handler) const;
+    template <class Handler>
+    void intersectDisks(const Ray &ray, U32 first, U32 slot, U32 count, F64 &distance, Handler &handler) const;
+    
+private:
+    std::vector<const SceneObject*> mObjects;
+    // Pool of every object and its index in that pool
+    std::vector<U8> mKinds;
+    std::vector<U32> mSlots;
+    
+    SphereArray mSpheres;
+    TriangleArray mTriangles;
+    DiskArray mDisks;
+};
+
+// Inlines
+
+template <class Handler>
+void PrimitivePool::intersect(const Ray &ray, U32 first, U32 count, F64 &distance, Handler &handler) const
+{
+    U32 end = first + count;
+    U32 i = first;
+    
+    while (i < end)
+    {
+        U8 kind = mKinds[i];
+        U32 run = i + 1;
+        
+        while (run < end && mKinds[run] == kind)
+            run++;
+        
+        switch (kind)
+        {
+            case SPHERES:
+                intersectSpheres(ray, i, mSlots[i], run - i, distance, handler);
+                break;
+            case TRIANGLES:
+                intersectTriangles(ray, i, mSlots[i], run - i, distance, handler);
+                break;
+            case DISKS:
+                intersectDisks(ray, i, mSlots[i], run - i, distance, handler);
+                break;
+            default:
+                for (U32 k = i; k < run; k++)
+                {
+                    if (intersectObject(k, ray, distance))
+                        handler.hit(mObjects[k]);
+                }
+                break;
+        }
+        i = run;
+    }
+}
+
+// The loops below repeat the operations of the intersect() they replace in the
+// same order, the pools give the same hits as the objects bit for bit
+
+template <class Handler>
+void PrimitivePool::intersectSpheres(const Ray &ray, U32 first, U32 slot, U32 count, F64 &distance, Handler &handler) const
+{
+    const Point3D &S = ray.getOrigin();
+    const Point3D &V = ray.getDirection();
+    F64 Vx = V.x * 2, Vy = V.y * 2, Vz = V.z * 2;
+    F64 dotSS = dot(S, S);
+    const F64 *Cx = &mSpheres.centerX[slot];
+    const F64 *Cy = &mSpheres.centerY[slot];
+    const F64 *Cz = &mSpheres.centerZ[slot];
+    const F64 *dotCC = &mSpheres.centerDot[slot];
+    const F64 *r2 = &mSpheres.squaredRadius[slot];
+    
+    for (U32 k = 0; k < count; k++)
+    {
+        F64 b = Vx * (S.x - Cx[k]) + Vy * (S.y - Cy[k]) + Vz * (S.z - Cz[k]);
+        F64 c = dotSS - ((S.x * Cx[k] + S.y * Cy[k] + S.z * Cz[k]) * 2) + dotCC[k] - r2[k];
+        F64 D = (b * b) - 4 * c;
+        bool hit = false;
+        
+        if (D > 0)
+        {
+            F64 sqrtD = sqrt(D);
+            F64 t1 = (-b - sqrtD) / 2;
+            F64 t2 = (-b + sqrtD) / 2;
+            
+            if (t1 > EPSILON && t1 < distance)
+            {
+                distance = t1;
+                hit = true;
+            }
+            if (t2 > EPSILON && t2 < distance)
+            {
+                distance = t2;
+                hit = true;
+            }
+        }
+        else if (isZero(D))
+        {
+            F64 t = -b / 2;
+            
+            if (t > EPSILON && t < distance)
+            {
+                distance = t;
+                hit = true;
+            }
+        }
+        
+        if (hit)
+            handler.hit(mObjects[first + k]);
+    }
+}
+
+template <class Handler>
+void PrimitivePool::intersectTriangles(const Ray &ray, U32 first, U32 slot, U32 count, F64 &distance, Handler &handler) const
+{
+    TriangleRay triangleRay(ray);
+    F64 t[PacketF64::SIZE];
+    U32 k = 0;
+    
+    // The hits of four triangles are taken in order, each still has to beat
+    // the ones before it like in the scalar loop
+    for (; k + PacketF64::SIZE <= count; k += PacketF64::SIZE)
+    {
+        U32 hits = mTriangles.intersect4(triangleRay, slot + k, distance, t);
+        
+        for (U32 lane = 0; hits; lane++, hits >>= 1)
+        {
+            if ((hits & 1) && t[lane] < distance)
+            {
+                distance = t[lane];
+                handler.hit(mObjects[first + k + lane]);
+            }
+        }
+    }
+    
+    for (; k < count; k++)
+    {
+        if (mTriangles.intersect(triangleRay, slot + k, distance, t[0]))
+        {
+            distance = t[0];
+            handler.hit(mObjects[first + k]);
+        }
+    }
+}
+
+template <class Handler>
+void PrimitivePool::intersectDisks(const Ray &ray, U32 first, U32 slot, U32 count, F64 &distance, Handler &handler) const
+{
+    const Point3D &S = ray.getOrigin();
+    const Point3D &V = ray.getDirection();
+    const DiskArray &disk = mDisks;
+    
+    for (U32 k = slot; k < slot + count; k++)
+    {
+        F64 dNV = disk.normalX[k] * V.x + disk.normalY[k] * V.y + disk.normalZ[k] * V.z;
+        
+        if (!(dNV > EPSILON || dNV < -EPSILON))
+            continue;
+        
+        F64 t = -((disk.normalX[k] * S.x + disk.normalY[k] * S.y + disk.normalZ[k] * S.z) + disk.planeD[k]) / dNV;
+        
+        if (!(t > EPSILON && t < distance))
+            continue;
+        
+        F64 dx = (S.x + V.x * t) - disk.centerX[k];
+        F64 dy = (S.y + V.y * t) - disk.centerY[k];
+        F64 dz = (S.z + V.z * t) - disk.centerZ[k];
+        F64 f1 = dx * dx + dy * dy + dz * dz - disk.squaredRadius[k];
+        
+        if ((disk.anti[k])? f1 >= EPSILON : f1 <= EPSILON)
+        {
+            distance = t;
+            handler.hit(mObjects[first + k - slot]);
+        }
+    }
+}
+
+#endif
\ No newline at end of file
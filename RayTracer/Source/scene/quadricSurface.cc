@@ -1,4 +1,5 @@
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 
 QuadricSurface::QuadricSurface(F64 a, F64 b, F64 c, F64 d, F64 e, F64 f, F64 g, F64 h, F64 j, F64 k) :
     mTexturePoly(NULL),
@@ -20,6 +21,7 @@ QuadricSurface::QuadricSurface(F64 a, F64 b, F64 c, F64 d, F64 e, F64 f, F64 g,
     
     for (U32 i = 0; i < 4; i++)
         mCutPlanes[i] = NULL;
+    classify();
 }
 
 QuadricSurface::~QuadricSurface()
@@ -96,7 +98,7 @@ PointUV QuadricSurface::getUV(const Point3D &point, const Point3D &normal) const
 
 Point3D QuadricSurface::getNormal(const Point3D &point) const
 {
-    F64 *m = mMatrix;
+    Real *m = mMatrix;
     F64 A = m[0];
     F64 B = m[5];
     F64 C = m[10];
@@ -119,36 +121,107 @@ Point3D QuadricSurface::getNormal(const Point3D &point) const
     return normal;
 }
 
+// Coordinate of a point or a vector along axis
+template <class T>
+inline T project(const Point3D &axis, const T *v)
+{
+    return T(axis.x) * v[0] + T(axis.y) * v[1] + T(axis.z) * v[2];
+}
+
+// Written once for F64 and PacketF64, every lane of a packet goes through the
+// same operations as a single ray
+template <class T>
+void QuadricSurface::getCoefficients(const T *S, const T *V, T &a, T &b, T &c) const
+{
+    T two(2.0);
+    
+    if (mForm == GENERAL)
+    {
+        const Real *m = mMatrix;
+        T A(m[0]);
+        T B(m[5]);
+        T C(m[10]);
+        T D(m[1]);
+        T E(m[6]);
+        T F(m[2]);
+        T G(m[3]);
+        T H(m[7]);
+        T J(m[11]);
+        T K(m[15]);
+        const T &xe = S[0], &ye = S[1], &ze = S[2];
+        const T &xd = V[0], &yd = V[1], &zd = V[2];
+        
+        a = A * xd * xd + B * yd * yd + C * zd * zd +
+        two * (D * xd * yd + E * yd * zd + F * xd * zd);
+        b = two * (A * xe * xd + B * ye * yd + C * ze * zd +
+                   D * xe * yd + D * ye * xd + E * ye * zd + E * ze * yd + F * ze * xd +
+                   F * xe * zd + G * xd + H * yd + J * zd);
+        c = A * xe * xe + B * ye * ye + C * ze * ze + two * (D * xe * ye + E * ye * ze + F *ze * xe +
+                                                             G * xe + H * ye + J * ze) + K;
+        return;
+    }
+    
+    T P[3] = { S[0] - T(mCenter.x), S[1] - T(mCenter.y), S[2] - T(mCenter.z) };
+    
+    if (mForm == SPHERE)
+    {
+        T scale(mScale[0]);
+        
+        a = scale * (V[0] * V[0] + V[1] * V[1] + V[2] * V[2]);
+        b = two * scale * (P[0] * V[0] + P[1] * V[1] + P[2] * V[2]);
+        c = scale * (P[0] * P[0] + P[1] * P[1] + P[2] * P[2]) + T(mConstant);
+        return;
+    }
+    
+    // Ray in the frame of the surface
+    T x0 = project(mAxes[0], P), v0 = project(mAxes[0], V);
+    T x1 = project(mAxes[1], P), v1 = project(mAxes[1], V);
+    T s0(mScale[0]), s1(mScale[1]);
+    
+    a = s0 * v0 * v0 + s1 * v1 * v1;
+    b = s0 * x0 * v0 + s1 * x1 * v1;
+    c = s0 * x0 * x0 + s1 * x1 * x1;
+    
+    if (mForm == CYLINDER)
+    {
+        b = two * b;
+        c = c + T(mConstant);
+        return;
+    }
+    
+    T x2 = project(mAxes[2], P), v2 = project(mAxes[2], V);
+    
+    // Paraboloids only use the third axis in the linear term
+    if (mForm == PARABOLOID)
+    {
+        T linear(mLinear);
+        
+        b = two * b + linear * v2;
+        c = c + linear * x2;
+        return;
+    }
+    
+    T s2(mScale[2]);
+    
+    a = a + s2 * v2 * v2;
+    b = two * (b + s2 * x2 * v2);
+    c = c + s2 * x2 * x2 + T(mConstant);
+}
+
 SceneObject::IntersectResult QuadricSurface::intersect(const Ray& ray, F64 &distance, IntersectionList *list) const
 {
-    F64 *m = mMatrix;
-    F64 A = m[0];
-    F64 B = m[5];
-    F64 C = m[10];
-    F64 D = m[1];
-    F64 E = m[6];
-    F64 F = m[2];
-    F64 G = m[3];
-    F64 H = m[7];
-    F64 J = m[11];
-    F64 K = m[15];
+    F64 lo, hi;
+    
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
+    
+    const Point3D &origin = ray.getOrigin();
+    const Point3D &direction = ray.getDirection();
+    F64 S[3] = { origin.x, origin.y, origin.z };
+    F64 V[3] = { direction.x, direction.y, direction.z };
+    F64 a, b, c;
     
-    const Point3D &S = ray.getOrigin();
-    const Point3D &V = ray.getDirection();
-    F64 xe = S.x;
-    F64 ye = S.y;
-    F64 ze = S.z;
-    F64 xd = V.x;
-    F64 yd = V.y;
-    F64 zd = V.z;
-    
-    F64 a = A * xd * xd + B * yd * yd + C * zd * zd +
-    2 * (D * xd * yd + E * yd * zd + F * xd * zd);
-    F64 b = 2 * (A * xe * xd + B * ye * yd + C * ze * zd +
-                 D * xe * yd + D * ye * xd + E * ye * zd + E * ze * yd + F * ze * xd +
-                 F * xe * zd + G * xd + H * yd + J * zd);
-    F64 c = A * xe * xe + B * ye * ye + C * ze * ze + 2 * (D * xe * ye + E * ye * ze + F *ze * xe +
-                                                           G * xe + H * ye + J * ze) + K;
+    getCoefficients(S, V, a, b, c);
     
     F64 disc = (b * b) - 4 * a * c;
     IntersectResult res = MISS;
@@ -159,18 +232,105 @@ SceneObject::IntersectResult QuadricSurface::intersect(const Ray& ray, F64 &dist
         F64 t1 = (-b - sqrtD) / (2 * a);
         F64 t2 = (-b + sqrtD) / (2 * a);
         
-        processIntersection(ray, t1, res, distance, list);
-        processIntersection(ray, t2, res, distance, list);
+        processIntersection(t1, lo, hi, res, distance, list);
+        processIntersection(t2, lo, hi, res, distance, list);
     }
     else if (isZero(disc))
     {
         F64 t = -b / (2 * a);
-        processIntersection(ray, t, res, distance, list);
+        processIntersection(t, lo, hi, res, distance, list);
     }
     
     return res;
 }
 
+// Same operations in the same order as intersect(), lane by lane
+U32 QuadricSurface::intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const
+{
+    F64 lo[RayPacket::SIZE], hi[RayPacket::SIZE];
+    
+    mask = clipToCutPlanes(packet, mask, lo, hi);
+    if (!mask)
+        return 0;
+    
+    PacketF64 two(2.0);
+    PacketF64 S[3] = { packet.getOrigin(0), packet.getOrigin(1), packet.getOrigin(2) };
+    PacketF64 V[3] = { packet.getDirection(0), packet.getDirection(1), packet.getDirection(2) };
+    PacketF64 a, b, c;
+    
+    getCoefficients(S, V, a, b, c);
+    
+    PacketF64 disc = (b * b) - PacketF64(4.0) * a * c;
+    
+    U32 twoRoots = (disc > PacketF64(EPSILON)).getBits() & mask;
+    U32 oneRoot = ((disc >= PacketF64(-EPSILON)) & (disc <= PacketF64(EPSILON))).getBits() & mask & ~twoRoots;
+    
+    if (!(twoRoots | oneRoot))
+        return 0;
+    
+    PacketF64 sqrtD = sqrt(disc);
+    F64 t1[RayPacket::SIZE], t2[RayPacket::SIZE], t[RayPacket::SIZE];
+    U32 hits = 0;
+    
+    ((-b - sqrtD) / (two * a)).store(t1);
+    ((-b + sqrtD) / (two * a)).store(t2);
+    (-b / (two * a)).store(t);
+    
+    for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+    {
+        if (twoRoots & (1 << lane))
+        {
+            processIntersection(lane, t1[lane], lo, hi, hits, distance);
+            processIntersection(lane, t2[lane], lo, hi, hits, distance);
+        }
+        else if (oneRoot & (1 << lane))
+            processIntersection(lane, t[lane], lo, hi, hits, distance);
+    }
+    return hits;
+}
+
+bool QuadricSurface::getExtent(Box3D &box) const
+{
+    Real *m = mMatrix;
+    F64 A = m[0];
+    F64 B = m[5];
+    F64 C = m[10];
+    F64 D = m[1];
+    F64 E = m[6];
+    F64 F = m[2];
+    
+    // Only ellipsoids are closed, their quadratic part M must be definite
+    F64 minor2 = A * B - D * D;
+    F64 det = A * (B * C - E * E) - D * (D * C - E * F) + F * (D * E - B * F);
+    
+    if (minor2 <= 0.0 || A * det <= 0.0)
+        return false;
+    
+    // inverse(M)
+    F64 i00 = (B * C - E * E) / det;
+    F64 i01 = (F * E - D * C) / det;
+    F64 i02 = (D * E - F * B) / det;
+    F64 i11 = (A * C - F * F) / det;
+    F64 i12 = (D * F - A * E) / det;
+    F64 i22 = minor2 / det;
+    
+    // Centered at c = -inverse(M) * g the surface is (p - c)^T M (p - c) = k
+    Point3D g(m[3], m[7], m[11]);
+    Point3D c(-(i00 * g.x + i01 * g.y + i02 * g.z),
+              -(i01 * g.x + i11 * g.y + i12 * g.z),
+              -(i02 * g.x + i12 * g.y + i22 * g.z));
+    F64 k = -dot(g, c) - m[15];
+    
+    box.empty();
+    if (A * k <= 0.0)
+        return true; // Imaginary ellipsoid
+    
+    Point3D e(sqrt(k * i00), sqrt(k * i11), sqrt(k * i22));
+    box.extend(c - e);
+    box.extend(c + e);
+    return true;
+}
+
 void QuadricSurface::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
 {
     if (mTexturePoly)
@@ -187,8 +347,233 @@ void QuadricSurface::transform(const MatrixD &m)
     
     mMatrix.mul(Wt, Q);
     mMatrix.mul(W);
+    classify();
+}
+
+// Eigenvalues and eigenvectors of the symmetric matrix a by Jacobi rotations.
+// a is left diagonal, the eigenvectors are the rows of axes
+static void diagonalize(F64 a[3][3], F64 axes[3][3])
+{
+    for (U32 i = 0; i < 3; i++)
+    {
+        for (U32 j = 0; j < 3; j++)
+            axes[i][j] = (i == j)? 1.0 : 0.0;
+    }
+    
+    for (U32 sweep = 0; sweep < 50; sweep++)
+    {
+        F64 diagonal = fabs(a[0][0]) + fabs(a[1][1]) + fabs(a[2][2]);
+        
+        if (fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]) <= diagonal * 1e-18)
+            break;
+        
+        for (U32 p = 0; p < 2; p++)
+        {
+            for (U32 q = p + 1; q < 3; q++)
+            {
+                if (a[p][q] == 0.0)
+                    continue;
+                
+                // Rotation in the pq plane that zeroes a[p][q]
+                F64 theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                F64 t = ((theta >= 0.0)? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                F64 c = 1.0 / sqrt(t * t + 1.0);
+                F64 s = t * c;
+                
+                for (U32 k = 0; k < 3; k++)
+                {
+                    F64 kp = a[k][p], kq = a[k][q];
+                    a[k][p] = c * kp - s * kq;
+                    a[k][q] = s * kp + c * kq;
+                }
+                for (U32 k = 0; k < 3; k++)
+                {
+                    F64 pk = a[p][k], qk = a[q][k];
+                    a[p][k] = c * pk - s * qk;
+                    a[q][k] = s * pk + c * qk;
+                    
+                    pk = axes[p][k];
+                    qk = axes[q][k];
+                    axes[p][k] = c * pk - s * qk;
+                    axes[q][k] = s * pk + c * qk;
+                }
+            }
+        }
+    }
+}
+
+// With M the upper 3x3 of the matrix, g its last column and k the corner the
+// surface is p^T M p + 2 * dot(g, p) + k = 0. In the frame of the eigenvectors
+// of M the cross terms go away, and moving the origin removes the linear term
+// along every axis with a non zero eigenvalue. What is left tells the form
+void QuadricSurface::classify()
+{
+    const Real *m = mMatrix;
+    F64 M[3][3] = { { m[0], m[1], m[2] }, { m[4], m[5], m[6] }, { m[8], m[9], m[10] } };
+    Point3D g(m[3], m[7], m[11]);
+    F64 k = m[15];
+    F64 size = 0.0;
+    
+    mForm = GENERAL;
+    mLinear = 0.0;
+    mConstant = 0.0;
+    
+    for (U32 i = 0; i < 3; i++)
+    {
+        for (U32 j = 0; j < 3; j++)
+            size = max(size, fabs(M[i][j]));
+    }
+    
+    // Planes and nothing at all
+    if (size == 0.0)
+        return;
+    
+    F64 tolerance = size * 1e-12;
+    
+    if (fabs(M[0][1]) <= tolerance && fabs(M[0][2]) <= tolerance && fabs(M[1][2]) <= tolerance &&
+        fabs(M[0][0] - M[1][1]) <= tolerance && fabs(M[0][0] - M[2][2]) <= tolerance)
+    {
+        F64 scale = (M[0][0] + M[1][1] + M[2][2]) / 3.0;
+        
+        mCenter = g / -scale;
+        mConstant = k + dot(g, mCenter);
+        mScale[0] = scale;
+        
+        // Otherwise a point or imaginary
+        if (scale * mConstant < 0.0)
+            mForm = SPHERE;
+        return;
+    }
+    
+    F64 axes[3][3];
+    diagonalize(M, axes);
+    
+    for (U32 i = 0; i < 3; i++)
+    {
+        mAxes[i].set(axes[i][0], axes[i][1], axes[i][2]);
+        mScale[i] = M[i][i];
+    }
+    
+    // The eigenvalue closest to zero goes last
+    U32 last = 2;
+    
+    for (U32 i = 0; i < 2; i++)
+    {
+        if (fabs(mScale[i]) < fabs(mScale[last]))
+            last = i;
+    }
+    if (last != 2)
+    {
+        Point3D axis = mAxes[last];
+        F64 scale = mScale[last];
+        
+        mAxes[last] = mAxes[2];
+        mScale[last] = mScale[2];
+        mAxes[2] = axis;
+        mScale[2] = scale;
+    }
+    
+    F64 largest = max(fabs(mScale[0]), max(fabs(mScale[1]), fabs(mScale[2])));
+    bool flat = fabs(mScale[2]) <= largest * 1e-10;
+    
+    // Only one squared axis left, the general path is as good
+    if (flat && min(fabs(mScale[0]), fabs(mScale[1])) <= largest * 1e-10)
+        return;
+    
+    F64 shift[3];
+    F64 constant = k;
+    F64 cancelled = fabs(k);
+    
+    for (U32 i = 0; i < ((flat)? 2 : 3); i++)
+    {
+        F64 linear = dot(mAxes[i], g);
+        
+        shift[i] = -linear / mScale[i];
+        constant += linear * shift[i];
+        cancelled += fabs(linear * shift[i]);
+    }
+    
+    if (flat)
+    {
+        F64 linear = dot(mAxes[2], g);
+        
+        if (fabs(linear) <= g.length() * 1e-10)
+        {
+            // Elliptic cylinders only, the rest are plane pairs or hyperbolic
+            if (mScale[0] * mScale[1] <= 0.0 || mScale[0] * constant >= 0.0)
+                return;
+            shift[2] = 0.0;
+            mConstant = constant;
+            mForm = CYLINDER;
+        }
+        else
+        {
+            // The constant goes into the linear term along the axis
+            mLinear = 2.0 * linear;
+            shift[2] = -constant / mLinear;
+            mForm = PARABOLOID;
+        }
+    }
+    else if (mScale[0] * mScale[1] > 0.0 && mScale[0] * mScale[2] > 0.0)
+    {
+        // Otherwise a point or imaginary
+        if (mScale[0] * constant >= 0.0)
+            return;
+        mConstant = constant;
+        mForm = ELLIPSOID;
+    }
+    else if (fabs(constant) <= cancelled * 1e-10)
+        mForm = CONE;
+    else
+    {
+        mConstant = constant;
+        mForm = HYPERBOLOID;
+    }
+    
+    mCenter = mAxes[0] * shift[0] + mAxes[1] * shift[1] + mAxes[2] * shift[2];
 }
 
 void QuadricSurface::transformUV(const MatrixD &m)
 {
 }
+
+void QuadricSurface::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.write(16 * sizeof(Real), (const Real *) mMatrix);
+    stream.write(mWidthLeft);
+    stream.write(mWidthRight);
+    stream.write(mHeightTop);
+    stream.write(mHeightBottom);
+    
+    for (U32 i = 0; i < 4; i++)
+        writeCutPlane(stream, mCutPlanes[i]);
+    
+    stream.write(mTexturePoly != NULL);
+    if (mTexturePoly)
+        mTexturePoly->write(stream);
+}
+
+bool QuadricSurface::read(SceneStream &stream)
+{
+    bool hasTexturePoly = false;
+    
+    Parent::read(stream);
+    stream.read(16 * sizeof(Real), (Real *) mMatrix);
+    classify();
+    stream.read(&mWidthLeft);
+    stream.read(&mWidthRight);
+    stream.read(&mHeightTop);
+    stream.read(&mHeightBottom);
+    
+    for (U32 i = 0; i < 4; i++)
+        mCutPlanes[i] = readCutPlane(stream);
+    
+    stream.read(&hasTexturePoly);
+    if (hasTexturePoly && stream.isOk())
+    {
+        mTexturePoly = new PolygonD();
+        mTexturePoly->read(stream);
+    }
+    return stream.isOk();
+}
@@ -6,6 +6,7 @@
 #include "core/file.h"
 #include "math/math.h"
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 #include <assert.h>
 
 using namespace X3DTK;
@@ -19,18 +20,68 @@ SceneObject::~SceneObject()
         delete plane;
     }
     
-    if (mTexture)
-        delete mTexture;
+    releaseShading();
+}
+
+const SceneObject::Shading SceneObject::smDefaultShading;
+
+SceneObject::SceneObject(const SceneObject &object) : mShading(NULL)
+{
+    copyShading(object);
+}
+
+SceneObject& SceneObject::operator=(const SceneObject &object)
+{
+    if (this != &object)
+        copyShading(object);
+    return *this;
+}
+
+void SceneObject::copyShading(const SceneObject &object)
+{
+    if (!object.mShading)
+    {
+        releaseShading();
+        return;
+    }
     
-    if (mBumpMap)
-        delete mBumpMap;
+    Shading &shading = getShading();
     
-    if (mNormalMap)
-        delete mNormalMap;
+    shading.material = object.mShading->material;
+    shading.north = object.mShading->north;
+    shading.greenwich = object.mShading->greenwich;
+    setRef(shading.texture, object.mShading->texture);
+    setRef(shading.bumpMap, object.mShading->bumpMap);
+    setRef(shading.normalMap, object.mShading->normalMap);
+    setRef(shading.opacityMap, object.mShading->opacityMap);
+}
+
+void SceneObject::releaseShading()
+{
+    if (!mShading)
+        return;
     
-    if (mOpacityMap)
-        delete mOpacityMap;
+    if (mShading->texture)
+        mShading->texture->release();
     
+    if (mShading->bumpMap)
+        mShading->bumpMap->release();
+    
+    if (mShading->normalMap)
+        mShading->normalMap->release();
+    
+    if (mShading->opacityMap)
+        mShading->opacityMap->release();
+    
+    delete mShading;
+    mShading = NULL;
+}
+
+SceneObject::Shading& SceneObject::getShading()
+{
+    if (!mShading)
+        mShading = new Shading();
+    return *mShading;
 }
 
 void SceneObject::transform(const MatrixD &m)
@@ -43,33 +94,239 @@ void SceneObject::transform(const MatrixD &m)
 
 void SceneObject::transformUV(const MatrixD &m)
 {
-    m.mul(mNorth);
-    m.mul(mGreenwich);
+    Shading &shading = getShading();
+    
+    m.mul(shading.north);
+    m.mul(shading.greenwich);
+}
+
+bool SceneObject::getBounds(Box3D &box) const
+{
+    if (!getExtent(box))
+        box.infinite();
+    
+    for (std::vector<Plane*>::const_iterator walk = mCutPlaneList.begin(); walk != mCutPlaneList.end(); walk++)
+        box.clip((*walk)->getAnchor(), (*walk)->getNormal());
+    
+    return box.isFinite();
 }
 
-bool SceneObject::isInsideCutPlane(const Ray& ray, F64 distance) const
+// The object is kept where dot(N, S + V * t - A) < -EPSILON for the normal N
+// and anchor A of every cut plane, each plane bounds t on one side
+bool SceneObject::clipToCutPlanes(const Ray& ray, F64 &lo, F64 &hi) const
 {
-    Point3D ip = ray.getOrigin() + (ray.getDirection() * distance);
+    const Point3D &S = ray.getOrigin();
+    const Point3D &V = ray.getDirection();
     
+    lo = EPSILON;
+    hi = F64_MAX;
     for (std::vector<Plane*>::const_iterator walk = mCutPlaneList.begin(); walk != mCutPlaneList.end(); walk++)
     {
-        Plane *plane = *walk;
-        Point3D vector = ip - plane->getAnchor();
-        vector.normalize();
-        if (dot(plane->getNormal(), vector) > -EPSILON)
+        const Point3D &N = (*walk)->getNormal();
+        
+        clipInterval(dot(N, V), dot(N, (*walk)->getAnchor()) - dot(N, S) - EPSILON, lo, hi);
+        if (lo >= hi)
             return false;
     }
     return true;
 }
 
+// Same operations in the same order as clipToCutPlanes(), lane by lane
+U32 SceneObject::clipToCutPlanes(const RayPacket &packet, U32 mask, F64 *lo, F64 *hi) const
+{
+    PacketF64 Lo(EPSILON), Hi(F64_MAX);
+    PacketF64 Sx = packet.getOrigin(0), Sy = packet.getOrigin(1), Sz = packet.getOrigin(2);
+    PacketF64 Vx = packet.getDirection(0), Vy = packet.getDirection(1), Vz = packet.getDirection(2);
+    
+    for (std::vector<Plane*>::const_iterator walk = mCutPlaneList.begin(); walk != mCutPlaneList.end(); walk++)
+    {
+        const Point3D &N = (*walk)->getNormal();
+        PacketF64 Nx(N.x), Ny(N.y), Nz(N.z);
+        PacketF64 a = Nx * Vx + Ny * Vy + Nz * Vz;
+        PacketF64 b = PacketF64(dot(N, (*walk)->getAnchor())) - (Nx * Sx + Ny * Sy + Nz * Sz) - PacketF64(EPSILON);
+        PacketF64 t = b / a;
+        PacketMask front = a > PacketF64(EPSILON);
+        PacketMask back = a < PacketF64(-EPSILON);
+        
+        // Rays along the plane are on one side or the other all the way
+        mask &= (front | back | (b >= PacketF64(0.0))).getBits();
+        Hi = select(front & (t < Hi), t, Hi);
+        Lo = select(back & (t > Lo), t, Lo);
+        mask &= (Lo < Hi).getBits();
+        if (!mask)
+            return 0;
+    }
+    Lo.store(lo);
+    Hi.store(hi);
+    return mask;
+}
+
+U32 SceneObject::intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const
+{
+    U32 hits = 0;
+    
+    for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+    {
+        if ((mask & (1 << lane)) && intersect(packet.getRay(lane), distance[lane]) == HIT)
+            hits |= 1 << lane;
+    }
+    return hits;
+}
+
+SceneObject* SceneObject::create(Type type)
+{
+    Point3D zero(0.0, 0.0, 0.0);
+    
+    switch (type)
+    {
+        case SPHERE:
+            return new Sphere(1.0);
+        case PLANE:
+            return new Plane(zero, zero);
+        case DISK:
+            return new Disk(1.0);
+        case CYLINDER:
+            return new Cylinder(1.0);
+        case CONE:
+            return new Cone(1.0);
+        case QUADRIC_SURFACE:
+            return new QuadricSurface(0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+        case POLYGON:
+            return new PolygonD();
+        case TRIANGLE:
+            return new Triangle();
+        case MESH:
+            return new TriangleMesh();
+        default:
+            return NULL;
+    }
+}
+
+void SceneObject::write(SceneStream &stream) const
+{
+    const Shading &shading = getShading();
+    
+    stream.write(shading.material);
+    stream.writeResource(shading.texture);
+    stream.writeResource(shading.bumpMap);
+    stream.writeResource(shading.normalMap);
+    stream.writeResource(shading.opacityMap);
+    stream.write(shading.north);
+    stream.write(shading.greenwich);
+    
+    stream.write((U32) mCutPlaneList.size());
+    for (std::vector<Plane*>::const_iterator walk = mCutPlaneList.begin(); walk != mCutPlaneList.end(); walk++)
+    {
+        stream.write((*walk)->getAnchor());
+        stream.write((*walk)->getNormal());
+    }
+}
+
+bool SceneObject::read(SceneStream &stream)
+{
+    Shading &shading = getShading();
+    U32 count = 0;
+    
+    // Straight to the members, subclasses restore their own copies
+    stream.read(&shading.material);
+    setRef(shading.texture, (Texture *) stream.readResource());
+    setRef(shading.bumpMap, (BumpMap *) stream.readResource());
+    setRef(shading.normalMap, (NormalMap *) stream.readResource());
+    setRef(shading.opacityMap, (OpacityMap *) stream.readResource());
+    stream.read(&shading.north);
+    stream.read(&shading.greenwich);
+    
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.isOk(); i++)
+    {
+        Point3D anchor, normal;
+        
+        stream.read(&anchor);
+        if (stream.read(&normal))
+            addCutPlane(new Plane(anchor, normal));
+    }
+    return stream.isOk();
+}
+
+void SceneObject::writeCutPlane(SceneStream &stream, const Plane *plane) const
+{
+    S32 index = -1;
+    
+    for (U32 i = 0; i < mCutPlaneList.size(); i++)
+    {
+        if (mCutPlaneList[i] == plane)
+            index = (S32) i;
+    }
+    stream.write(index);
+}
+
+Plane* SceneObject::readCutPlane(SceneStream &stream) const
+{
+    S32 index;
+    
+    if (!stream.read(&index) || index < -1 || index >= getCutPlaneCount())
+    {
+        stream.fail();
+        return NULL;
+    }
+    return (index < 0)? NULL : mCutPlaneList[index];
+}
+
 Scene::~Scene()
 {
+    clear();
+}
+
+void Scene::clear()
+{
+    while (!mObjList.empty())
+    {
+        SceneObject *object = mObjList.back();
+        mObjList.pop_back();
+        delete object;
+    }
+    mUnboundedList.clear();
+    mBVH.clear();
+    mPrimitives.clear();
+    mLightIndex.clear();
+    
     while (!mLightList.empty())
     {
         PointLight *light = mLightList.back();
         mLightList.pop_back();
         delete light;
     }
+    
+    while (!mVertexTableList.empty())
+    {
+        Point3D *vertexTable = mVertexTableList.back();
+        mVertexTableList.pop_back();
+        delete[] vertexTable;
+    }
+    mVertexCountList.clear();
+    mTextureCache.clear();
+}
+
+void Scene::resetCounts()
+{
+    transformationCount = 0;
+    polygonCount        = 0;
+    cutPlaneCount       = 0;
+    cylinderCount       = 0;
+    diskCount           = 0;
+    sphereCount         = 0;
+    coneCount           = 0;
+    quadricCount        = 0;
+    meshCount           = 0;
+    triangleCount       = 0;
+}
+
+Point3D* Scene::createVertexTable(U32 count)
+{
+    Point3D *vertexTable = new Point3D[count];
+    mVertexTableList.push_back(vertexTable);
+    mVertexCountList.push_back(count);
+    return vertexTable;
 }
 
 static bool checkOpacityMap(const SceneObject *obj, PointUV &uv)
@@ -88,128 +345,358 @@ static bool checkOpacityMap(const SceneObject *obj, PointUV &uv)
     return true;
 }
 
-// TODO: Improve OpacityMap workaround
-const SceneObject* Scene::findClosestIntersection(const Ray& ray, Point3D &intersection, Point3D &normal, PointUV &uv, F64& distance)
+static bool checkOpacityMap(const SceneObject *obj, U32 primitive, const Ray &ray, const Point3D &intersection)
 {
-    SceneObject::IntersectResult res;
-    SceneObject *intersectedObj = NULL;
-    SceneObject *prevIntersectedObj = NULL;
-    Point3D prevIntersection;
-    Point3D prevNormal;
-    PointUV prevUV;
-    F64 prevDistance = distance;
+    Point3D normal = obj->getPrimitiveNormal(intersection, primitive);
     
-    for (std::vector<SceneObject*>::const_iterator walk = mObjList.begin(); walk != mObjList.end(); walk++)
+    if (dot(normal, ray.getDirection()) > EPSILON) // Use correct normal
+        normal *= -1;
+    
+    PointUV uv = obj->getUV(intersection, normal);
+    return checkOpacityMap(obj, uv);
+}
+
+SceneObject::IntersectResult SceneObject::intersectOpaque(const Ray& ray, F64 &distance) const
+{
+    U32 primitive;
+    
+    return intersectOpaque(ray, distance, primitive);
+}
+
+SceneObject::IntersectResult SceneObject::intersectOpaque(const Ray& ray, F64 &distance, U32 &primitive) const
+{
+    const OpacityMap *opacityMap = getOpacityMap();
+    
+    if (!opacityMap || opacityMap->getCoverage() == OpacityMap::OPAQUE)
+        return intersectPrimitive(ray, distance, primitive);
+    
+    if (opacityMap->getCoverage() == OpacityMap::EMPTY)
+        return MISS;
+    
+    F64 start = 0.0;
+    Ray next = ray;
+    
+    while (true)
     {
-        SceneObject *obj = *walk;
+        F64 t = distance - start;
+        
+        if (intersectPrimitive(next, t, primitive) != HIT)
+            return MISS;
         
-        res = obj->intersect(ray, distance);
+        start += t;
+        Point3D intersection = ray.getOrigin() + (ray.getDirection() * start);
         
-        if (res == SceneObject::HIT)
+        if (checkOpacityMap(this, primitive, ray, intersection))
         {
-            intersection = ray.getOrigin() + (ray.getDirection() * distance);
-            normal = obj->getNormal(intersection);
-            
-            if (dot(normal, ray.getDirection()) > EPSILON) // Use correct normal
-                normal *= -1;
-            
-            if (obj->getTexture() || obj->getBumpMap() || obj->getOpacityMap())
-                uv = obj->getUV(intersection, normal);
-            
-            if (checkOpacityMap(obj, uv))
-            {
-                intersectedObj = obj;
-                prevIntersectedObj = obj;
-                prevIntersection = intersection;
-                prevNormal = normal;
-                prevUV = uv;
-                prevDistance = distance;
-                
-            }
-            else
-            {
-                intersectedObj = prevIntersectedObj;
-                intersection = prevIntersection;
-                normal = prevNormal;
-                uv = prevUV;
-                distance = prevDistance;
-            }
+            distance = start;
+            return HIT;
         }
+        next = Ray(intersection, ray.getDirection());
     }
-    return intersectedObj;
 }
 
-// TODO: Improve OpacityMap workaround
-void Scene::findIntersections(const Ray &ray, IntersectionList &list)
+void Scene::buildAccelerator()
 {
-    Point3D intersection;
-    Point3D normal;
-    PointUV uv;
-    F64   ignoredDistance = F64_MAX;
-    IntersectionList::IntersectionListNode *prevFirst = NULL;
+    Box3D bounds;
     
+    mUnboundedList.clear();
     for (std::vector<SceneObject*>::const_iterator walk = mObjList.begin(); walk != mObjList.end(); walk++)
     {
-        SceneObject::IntersectResult res = (*walk)->intersect(ray, ignoredDistance, &list);
-        IntersectionList::IntersectionListNode *first = list.getFirst();
+        // Objects completely removed by their cut planes are skipped by the BVH too
+        if (!(*walk)->getBounds(bounds))
+            mUnboundedList.push_back(*walk);
+    }
+    mBVH.build(mObjList);
+    mPrimitives.build(mBVH.getObjects());
+    mLightIndex.build(mLightList);
+}
+
+// Only records the closest object, the surface at the hit is evaluated once the
+// traversal is done. The alpha test of objects with an opacity map is part of
+// their intersection, see SceneObject::intersectOpaque().
+class ClosestHitVisitor
+{
+public:
+    ClosestHitVisitor(const Ray &ray, const PrimitivePool &primitives) : mRay(ray), mPrimitives(primitives), intersectedObj(NULL), primitive(0)
+    {
+    }
+    
+    bool operator()(const SceneObject *obj, F64 &distance)
+    {
+        U32 hitPrimitive;
         
-        if (prevFirst != first)
+        if (obj->intersectOpaque(mRay, distance, hitPrimitive) == SceneObject::HIT)
         {
-            const SceneObject *obj = first->getObject();
-            intersection = ray.getOrigin() + (ray.getDirection() * ignoredDistance);
-            normal = obj->getNormal(intersection);
-            
-            if (dot(normal, ray.getDirection()) > EPSILON) // Use correct normal
-                normal *= -1;
-            
-            if (obj->getOpacityMap() && !checkOpacityMap(obj, obj->getUV(intersection, normal)))
+            intersectedObj = obj;
+            primitive = hitPrimitive;
+        }
+        return false;
+    }
+    
+    bool operator()(U32 first, U32 count, F64 &distance)
+    {
+        mPrimitives.intersect(mRay, first, count, distance, *this);
+        return false;
+    }
+    
+    void hit(const SceneObject *obj)
+    {
+        intersectedObj = obj;
+        primitive = 0;
+    }
+    
+private:
+    const Ray &mRay;
+    const PrimitivePool &mPrimitives;
+public:
+    const SceneObject *intersectedObj;
+    U32 primitive;
+};
+
+// ClosestHitVisitor for every lane of a packet
+class ClosestHitPacketVisitor
+{
+public:
+    ClosestHitPacketVisitor(const RayPacket &packet, const PrimitivePool &primitives, const SceneObject **objects, U32 *hitPrimitives) :
+        mPacket(packet), mPrimitives(primitives), mObjects(objects), mHitPrimitives(hitPrimitives)
+    {
+    }
+    
+    void operator()(U32 first, U32 count, F64 *distance, U32 mask)
+    {
+        for (U32 i = first; i < first + count; i++)
+            (*this)(mPrimitives.getObject(i), distance, mask);
+    }
+    
+    void operator()(const SceneObject *obj, F64 *distance, U32 mask)
+    {
+        // Alpha tested objects go ray by ray, and so do meshes to know the
+        // triangle hit
+        if (obj->getOpacityMap() || obj->getType() == SceneObject::MESH)
+        {
+            for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
             {
-                list.pop();
+                U32 primitive;
+                
+                if ((mask & (1 << lane)) && obj->intersectOpaque(mPacket.getRay(lane), distance[lane], primitive) == SceneObject::HIT)
+                {
+                    mObjects[lane] = obj;
+                    mHitPrimitives[lane] = primitive;
+                }
+            }
+            return;
+        }
+        
+        U32 hits = obj->intersectPacket(mPacket, distance, mask);
+        
+        for (U32 lane = 0; hits && lane < RayPacket::SIZE; lane++)
+        {
+            if (hits & (1 << lane))
+            {
+                mObjects[lane] = obj;
+                mHitPrimitives[lane] = 0;
             }
-            prevFirst = list.getFirst();
         }
     }
+    
+private:
+    const RayPacket &mPacket;
+    const PrimitivePool &mPrimitives;
+    const SceneObject **mObjects;
+    U32 *mHitPrimitives;
+};
+
+const SceneObject* Scene::findClosestObject(const Ray &ray, F64 &distance, U32 &primitive) const
+{
+    ClosestHitVisitor visitor(ray, mPrimitives);
+    
+    for (std::vector<SceneObject*>::const_iterator walk = mUnboundedList.begin(); walk != mUnboundedList.end(); walk++)
+        visitor(*walk, distance);
+    
+    mBVH.traverse(ray, distance, visitor);
+    primitive = visitor.primitive;
+    return visitor.intersectedObj;
 }
 
-IntersectionList::~IntersectionList()
+const SceneObject* Scene::findClosestIntersection(const Ray& ray, Point3D &intersection, Point3D &normal, PointUV &uv, F64& distance) const
 {
-    clear();
+    U32 primitive;
+    const SceneObject *obj = findClosestObject(ray, distance, primitive);
+    
+    if (obj)
+        getSurface(obj, primitive, ray, distance, intersection, normal, uv);
+    return obj;
 }
 
-void IntersectionList::clear()
+void Scene::findClosestIntersections(const RayPacket &packet, const SceneObject **objects, U32 *primitives, F64 *distance) const
 {
-    for (IntersectionListNode *walk = mFirst; walk != NULL;)
+    U32 mask = packet.getMask();
+    
+    for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+        objects[lane] = NULL;
+    
+    if (!packet.isCoherent())
     {
-        IntersectionListNode *deleteMe = walk;
-        walk = walk->mNext;
-        delete deleteMe;
+        for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+        {
+            if (mask & (1 << lane))
+                objects[lane] = findClosestObject(packet.getRay(lane), distance[lane], primitives[lane]);
+        }
+        return;
     }
-    mFirst = NULL;
+    
+    ClosestHitPacketVisitor visitor(packet, mPrimitives, objects, primitives);
+    
+    for (std::vector<SceneObject*>::const_iterator walk = mUnboundedList.begin(); walk != mUnboundedList.end(); walk++)
+        visitor(*walk, distance, mask);
+    
+    mBVH.traverse(packet, distance, mask, visitor);
 }
 
-void IntersectionList::pop()
+void Scene::getSurface(const SceneObject *obj, U32 primitive, const Ray &ray, F64 distance, Point3D &intersection, Point3D &normal, PointUV &uv) const
 {
-    IntersectionListNode *deleteMe = mFirst;
+    intersection = ray.getOrigin() + (ray.getDirection() * distance);
+    normal = obj->getPrimitiveNormal(intersection, primitive);
     
-    mFirst = mFirst->mNext;
-    delete deleteMe;
+    if (dot(normal, ray.getDirection()) > EPSILON) // Use correct normal
+        normal *= -1;
+    
+    if (obj->getTexture() || obj->getBumpMap() || obj->getOpacityMap())
+        uv = obj->getUV(intersection, normal);
 }
 
-void IntersectionList::add(const SceneObject *obj, F64 distance)
+class AllHitsVisitor
 {
-    IntersectionListNode *node = new IntersectionListNode();
-    node->mObj = obj;
-    node->mDistance = distance;
-    node->mNext = mFirst;
-    mFirst = node;
+public:
+    AllHitsVisitor(const Ray &ray, const PrimitivePool &primitives, IntersectionList &list) : mRay(ray), mPrimitives(primitives), mList(list)
+    {
+    }
+    
+    bool operator()(U32 first, U32 count, F64 &distance)
+    {
+        for (U32 i = first; i < first + count; i++)
+            (*this)(mPrimitives.getObject(i), distance);
+        return false;
+    }
+    
+    bool operator()(const SceneObject *obj, F64 &)
+    {
+        // Every object gets the whole ray so the hits don't depend on the visiting order
+        F64 distance = F64_MAX;
+        
+        if (!obj->getOpacityMap())
+        {
+            obj->intersect(mRay, distance, &mList);
+            return false;
+        }
+        
+        // Opaque hits one after the other
+        F64 start = 0.0;
+        Ray ray = mRay;
+        
+        while (obj->intersectOpaque(ray, distance) == SceneObject::HIT)
+        {
+            start += distance;
+            mList.add(obj, start);
+            ray = Ray(mRay.getOrigin() + (mRay.getDirection() * start), mRay.getDirection());
+            distance = F64_MAX;
+        }
+        return false;
+    }
+    
+private:
+    const Ray &mRay;
+    const PrimitivePool &mPrimitives;
+    IntersectionList &mList;
+};
+
+void Scene::findIntersections(const Ray &ray, IntersectionList &list) const
+{
+    AllHitsVisitor visitor(ray, mPrimitives, list);
+    F64 distance = F64_MAX;
+    
+    for (std::vector<SceneObject*>::const_iterator walk = mUnboundedList.begin(); walk != mUnboundedList.end(); walk++)
+        visitor(*walk, distance);
+    
+    mBVH.traverse(ray, distance, visitor);
 }
 
+// Steps through the hits of each object up to the maximum distance, restarting
+// the ray at the previous hit, and multiplies the translucency of every surface
+// crossed. Stops the traversal once the light is blocked.
+class OcclusionVisitor
+{
+public:
+    OcclusionVisitor(const Ray &ray, const PrimitivePool &primitives, F64 maxDistance) :
+        mRay(ray), mPrimitives(primitives), mMaxDistance(maxDistance), transmittance(1.0f)
+    {
+    }
+    
+    bool operator()(U32 first, U32 count, F64 &distance)
+    {
+        for (U32 i = first; i < first + count; i++)
+        {
+            if ((*this)(mPrimitives.getObject(i), distance))
+                return true;
+        }
+        return false;
+    }
+    
+    bool operator()(const SceneObject *obj, F64 &)
+    {
+        F32 kt = obj->getMaterial().translucency;
+        F64 start = 0.0;
+        Ray ray = mRay;
+        
+        while (true)
+        {
+            F64 distance = mMaxDistance - start;
+            
+            if (obj->intersectOpaque(ray, distance) != SceneObject::HIT)
+                return false;
+            
+            start += distance;
+            transmittance *= kt;
+            if (transmittance <= EPSILON)
+                return true;
+            ray = Ray(mRay.getOrigin() + (mRay.getDirection() * start), mRay.getDirection());
+        }
+    }
+    
+private:
+    const Ray &mRay;
+    const PrimitivePool &mPrimitives;
+    F64 mMaxDistance;
+public:
+    F32 transmittance;
+};
+
+F32 Scene::occlusion(const Ray &ray, F64 maxDistance) const
+{
+    OcclusionVisitor visitor(ray, mPrimitives, maxDistance);
+    F64 distance = maxDistance;
+    
+    for (std::vector<SceneObject*>::const_iterator walk = mUnboundedList.begin(); walk != mUnboundedList.end(); walk++)
+    {
+        if (visitor(*walk, distance))
+            return 0.0f;
+    }
+    
+    mBVH.traverse(ray, distance, visitor);
+    return (visitor.transmittance > EPSILON)? visitor.transmittance : 0.0f;
+}
+
+class MyVisitor;
+
 class SceneProcessor : public X3DOnePassProcessor
 {
 public:
-    SceneProcessor();
+    SceneProcessor(Scene *scene);
     
     void process(X3D::Scene *scene);
+    
+private:
+    MyVisitor *mVisitor;
 };
 
 class MyVisitor : public X3DComponentVisitor
@@ -230,10 +717,8 @@ public:
     
     void addCutPlanes(SceneObject *obj);
     void tranformObject(SceneObject *obj);
-private:
-    void loadTexture(Texture *texture, const X3D::ImageTexture *textureNode, const char *url);
 public:
-    MyVisitor();
+    MyVisitor(Scene *_scene);
     
     void addObject(SceneObject *obj)
     {
@@ -255,6 +740,31 @@ public:
         scene->addObject(obj);
     }
     
+    // Meshes are prepared once, after they are moved to world space
+    void addMesh(TriangleMesh *mesh)
+    {
+        addObject(mesh);
+        mesh->initialize();
+        scene->meshCount++;
+        scene->triangleCount += mesh->getTriangleCount();
+    }
+    
+    // Mesh with the points of a Coordinate node, NULL for other nodes
+    static TriangleMesh* createMesh(X3D::X3DNode *coordNode)
+    {
+        X3D::Coordinate *coord = dynamic_cast<X3D::Coordinate*>(coordNode);
+        
+        if (!coord)
+            return NULL;
+        
+        const MFVec3f &points = coord->getPoint();
+        TriangleMesh *mesh = new TriangleMesh();
+        
+        for (MFVec3f::const_iterator walk = points.begin(); walk != points.end(); walk++)
+            mesh->addVertex(Point3D(walk->x, walk->y, walk->z));
+        return mesh;
+    }
+    
 public:
     static void enterX3DViewpointNode(X3D::Viewpoint*);
     static void enterX3DTransformNode(X3D::Transform*);
@@ -268,25 +778,42 @@ public:
     static void enterX3DSphereNode(X3D::Sphere*);
     static void enterX3DCutPlaneNode(X3D::CutPlane*);
     static void enterX3DPolygonNode(X3D::Polygon*);
+    static void enterX3DIndexedFaceSetNode(X3D::IndexedFaceSet*);
+    static void enterX3DIndexedTriangleSetNode(X3D::IndexedTriangleSet*);
     static void enterX3DQuadricSurfaceNode(X3D::QuadricSurface*);
     static void enterX3DDiskNode(X3D::Disk*);
     
-} gVisitor;
-
+};
 
+// The X3DTK callbacks are static, they reach the loader state of the scene being
+// processed on the calling thread through this pointer
+static THREAD_LOCAL MyVisitor *gVisitor = NULL;
 
-SceneProcessor::SceneProcessor()
+SceneProcessor::SceneProcessor(Scene *scene)
 {
+    mVisitor = new MyVisitor(scene);
     setGraphTraversal(new DFSGraphTraversal());
-    setComponentVisitor(new MyVisitor());
+    setComponentVisitor(mVisitor);
 }
 
 void SceneProcessor::process(X3D::Scene *scene)
 {
+    MyVisitor *prevVisitor = gVisitor;
+    
+    gVisitor = mVisitor;
     traverse(scene);
+    gVisitor = prevVisitor;
 }
 
-MyVisitor::MyVisitor() : X3DComponentVisitor(), texture(NULL), bumpMap(NULL)
+MyVisitor::MyVisitor(Scene *_scene) :
+    X3DComponentVisitor(),
+    scene(_scene),
+    texture(NULL),
+    bumpMap(NULL),
+    normalMap(NULL),
+    opacityMap(NULL),
+    north(NULL),
+    greenwich(NULL)
 {
     
     
@@ -304,6 +831,8 @@ MyVisitor::MyVisitor() : X3DComponentVisitor(), texture(NULL), bumpMap(NULL)
     define(Recorder<X3D::ImageTexture>::getEnterFunction(&MyVisitor::enterX3DImageTextureNode));
     define(Recorder<X3D::CutPlane>::getEnterFunction(&MyVisitor::enterX3DCutPlaneNode));
     define(Recorder<X3D::Polygon>::getEnterFunction(&MyVisitor::enterX3DPolygonNode));
+    define(Recorder<X3D::IndexedFaceSet>::getEnterFunction(&MyVisitor::enterX3DIndexedFaceSetNode));
+    define(Recorder<X3D::IndexedTriangleSet>::getEnterFunction(&MyVisitor::enterX3DIndexedTriangleSetNode));
     define(Recorder<X3D::QuadricSurface>::getEnterFunction(&MyVisitor::enterX3DQuadricSurfaceNode));
     define(Recorder<X3D::Disk>::getEnterFunction(&MyVisitor::enterX3DDiskNode));
 }
@@ -312,7 +841,7 @@ MyVisitor::MyVisitor() : X3DComponentVisitor(), texture(NULL), bumpMap(NULL)
 void MyVisitor::enterX3DViewpointNode(X3D::Viewpoint* viewpointNode)
 {
     SFVec3f pos = viewpointNode->getPosition();
-    gVisitor.scene->setViewpoint(Point3D(pos.x, pos.y, pos.z));
+    gVisitor->scene->setViewpoint(Point3D(pos.x, pos.y, pos.z));
 }
 
 inline static void mat_rotateX(MatrixD &mat, const F64 theta)
@@ -447,51 +976,51 @@ void MyVisitor::enterX3DTransformNode(X3D::Transform *transformNode)
     cMat.setRow(3, row);
     
     m->mul(cMat);
-    gVisitor.matrixList.push_back(m);
+    gVisitor->matrixList.push_back(m);
     //m = new  MatrixD();
-    gVisitor.textureMatrixList.push_back(new MatrixD(rMat));
+    gVisitor->textureMatrixList.push_back(new MatrixD(rMat));
 }
 
 void MyVisitor::leaveX3DTransformNode(X3D::Transform*)
 {
-    MatrixD* matrix = gVisitor.matrixList.back();
-    gVisitor.matrixList.pop_back();
+    MatrixD* matrix = gVisitor->matrixList.back();
+    gVisitor->matrixList.pop_back();
     delete matrix;
     
-    matrix = gVisitor.textureMatrixList.back();
-    gVisitor.textureMatrixList.pop_back();
+    matrix = gVisitor->textureMatrixList.back();
+    gVisitor->textureMatrixList.pop_back();
     delete matrix;
     
 }
 
 void MyVisitor::addCutPlanes(SceneObject *obj)
 {
-    std::vector<Plane*> *planeList = &gVisitor.planeList;
+    std::vector<Plane*> *planeList = &gVisitor->planeList;
     for (std::vector<Plane*>::const_iterator walk = planeList->begin(); walk != planeList->end(); walk++)
         obj->addCutPlane(*walk);
 }
 
 void MyVisitor::tranformObject(SceneObject *obj)
 {
-    std::vector<MatrixD*>* vector = &gVisitor.matrixList;
+    std::vector<MatrixD*>* vector = &gVisitor->matrixList;
     
     if (obj && vector->size() > 0)
     {
         for (std::vector<MatrixD*>::const_reverse_iterator walk = vector->rbegin(); walk != vector->rend(); walk++)
         {
             obj->transform(**walk);
-            gVisitor.scene->transformationCount++;
+            gVisitor->scene->transformationCount++;
         }
     }
     
-    vector = &gVisitor.textureMatrixList;
+    vector = &gVisitor->textureMatrixList;
     
     if (obj && vector->size() > 0)
     {
         for (std::vector<MatrixD*>::const_reverse_iterator walk = vector->rbegin(); walk != vector->rend(); walk++)
         {
             obj->transformUV(**walk);
-            gVisitor.scene->transformationCount++;
+            gVisitor->scene->transformationCount++;
         }
     }
 }
@@ -505,12 +1034,12 @@ void MyVisitor::enterX3DPointLightNode(X3D::PointLight* pointLightNode)
                                             ColorF(color.r, color.g, color.b));
     SFVec3f att = pointLightNode->getAttenuation();
     pointLight->setAttenuationConstants(att.x, att.y, att.z);
-    gVisitor.scene->addLight(pointLight);
+    gVisitor->scene->addLight(pointLight);
 }
 
 void MyVisitor::enterX3DMaterialNode(X3D::Material *materialNode)
 {
-    Material &material = gVisitor.material;
+    Material &material = gVisitor->material;
     material.ambientIntensity = materialNode->getAmbientIntensity();
     const SFColor &diffusiveColor = materialNode->getDiffuseColor();
     material.diffusseCoefficient = materialNode->getDiffuseCoefficient();
@@ -527,92 +1056,66 @@ void MyVisitor::enterX3DMaterialNode(X3D::Material *materialNode)
     assert(isZero(material.diffusiveness + material.reflectiveness + material.transparency - 1.0f));
 }
 
-void MyVisitor::loadTexture(Texture *texture, const X3D::ImageTexture *textureNode, const char *url)
-{
-    File file;
-    
-    file.open(url, File::Read);
-    texture->bitmap.read(file);
-    SFVec3f north = textureNode->getNorth();
-    SFVec3f greenwich = textureNode->getGreenwich();
-    gVisitor.north = new Point3D();
-    gVisitor.north->set(north.x, north.y, north.z);
-    gVisitor.north->normalize();
-    gVisitor.greenwich = new Point3D();
-    gVisitor.greenwich->set(greenwich.x, greenwich.y, greenwich.z);
-    gVisitor.greenwich->normalize();
-    texture->hTile = textureNode->getHTile();
-    texture->vTile = textureNode->getVTile();
-    texture->hTileSize = texture->hTile * texture->bitmap.width;
-    texture->vTileSize = texture->vTile * texture->bitmap.height;
-}
-
-
 void MyVisitor::enterX3DImageTextureNode(X3D::ImageTexture* textureNode)
 {
     MFString strVect = textureNode->getUrl();
     std::string texturePath("C:\\Documents and Settings\\merizald\\My Documents\\Visual Studio 2005\\Projects\\RayTracer\\RayTracer\\textures\\");
+    TextureCache &cache = gVisitor->scene->getTextureCache();
+    U32 hTile = textureNode->getHTile();
+    U32 vTile = textureNode->getVTile();
+    bool loaded = false;
     
     // Texture
     if (strVect.size() > 0 && strVect[0].length() > 0)
     {
-        Texture *texture = new Texture();
         std::string url = texturePath + strVect[0];
-        gVisitor.loadTexture(texture, textureNode, url.data());
-        gVisitor.texture = texture;
+        gVisitor->texture = cache.getTexture(url.data(), hTile, vTile);
+        loaded = true;
     }
     
     if (strVect.size() > 1 && strVect[1].length() > 0)
     {
-        Texture *texture = new Texture();
         std::string url = texturePath + strVect[1];
-        gVisitor.loadTexture(texture, textureNode, url.data());
-        BumpMap *bumpMap = new BumpMap();
-        bumpMap->init(texture, textureNode->getMinHeight(), textureNode->getMaxHeight());
-        bumpMap->hTile = texture->hTile;
-        bumpMap->vTile = texture->vTile;
-        bumpMap->hTileSize = texture->hTileSize;
-        bumpMap->vTileSize = texture->vTileSize;
-        gVisitor.bumpMap = bumpMap;
-        delete texture;
+        gVisitor->bumpMap = cache.getBumpMap(url.data(), hTile, vTile, textureNode->getMinHeight(), textureNode->getMaxHeight());
+        loaded = true;
     }
     
     if (strVect.size() > 2 && strVect[2].length() > 0)
     {
-        Texture *texture = new Texture();
         std::string url = texturePath + strVect[2];
-        gVisitor.loadTexture(texture, textureNode, url.data());
-        OpacityMap *opacityMap = new OpacityMap();
-        opacityMap->init(texture, textureNode->getTolerance());
-        opacityMap->hTile = texture->hTile;
-        opacityMap->vTile = texture->vTile;
-        opacityMap->hTileSize = texture->hTileSize;
-        opacityMap->vTileSize = texture->vTileSize;
-        gVisitor.opacityMap = opacityMap;
-        delete texture;
+        gVisitor->opacityMap = cache.getOpacityMap(url.data(), hTile, vTile, textureNode->getTolerance());
+        loaded = true;
     }
     
     if (strVect.size() > 3 && strVect[3].length() > 0)
     {
-        Texture *texture = new Texture();
         std::string url = texturePath + strVect[3];
-        gVisitor.loadTexture(texture, textureNode, url.data());
-        NormalMap *normalMap = new NormalMap();
-        normalMap->init(texture);
-        normalMap->hTile = texture->hTile;
-        normalMap->vTile = texture->vTile;
-        normalMap->hTileSize = texture->hTileSize;
-        normalMap->vTileSize = texture->vTileSize;
-        gVisitor.normalMap = normalMap;
-        delete texture;
+        gVisitor->normalMap = cache.getNormalMap(url.data(), hTile, vTile);
+        loaded = true;
+    }
+    
+    if (loaded)
+    {
+        SFVec3f north = textureNode->getNorth();
+        SFVec3f greenwich = textureNode->getGreenwich();
+        
+        if (!gVisitor->north)
+            gVisitor->north = new Point3D();
+        gVisitor->north->set(north.x, north.y, north.z);
+        gVisitor->north->normalize();
+        
+        if (!gVisitor->greenwich)
+            gVisitor->greenwich = new Point3D();
+        gVisitor->greenwich->set(greenwich.x, greenwich.y, greenwich.z);
+        gVisitor->greenwich->normalize();
     }
 }
 
 void MyVisitor::enterX3DSphereNode(X3D::Sphere *sphereNode)
 {
     Sphere *sphere = new Sphere(sphereNode->getRadius());
-    gVisitor.addObject(sphere);
-    gVisitor.scene->sphereCount++;
+    gVisitor->addObject(sphere);
+    gVisitor->scene->sphereCount++;
 }
 
 void MyVisitor::enterX3DConeNode(X3D::Cone *coneNode)
@@ -624,8 +1127,8 @@ void MyVisitor::enterX3DConeNode(X3D::Cone *coneNode)
         cone = new Cone(coneNode->getBottomRadius());
     else
         cone = new Cone(coneNode->getBottomRadius(), coneNode->getHeight());
-    gVisitor.addObject(cone);
-    gVisitor.scene->coneCount++;
+    gVisitor->addObject(cone);
+    gVisitor->scene->coneCount++;
 }
 
 void MyVisitor::enterX3DCylinderNode(X3D::Cylinder *cylinderNode)
@@ -644,10 +1147,10 @@ void MyVisitor::enterX3DCylinderNode(X3D::Cylinder *cylinderNode)
         // Fix me
         Disk *top = NULL;
         cylinder->createTop(&top);
-        top->setMaterial(gVisitor.material);
-        gVisitor.tranformObject(top);
-        gVisitor.scene->addObject(top);
-        gVisitor.scene->diskCount++;
+        top->setMaterial(gVisitor->material);
+        gVisitor->tranformObject(top);
+        gVisitor->scene->addObject(top);
+        gVisitor->scene->diskCount++;
     }
     
     if (isFinite && cylinderNode->getBottom())
@@ -655,13 +1158,13 @@ void MyVisitor::enterX3DCylinderNode(X3D::Cylinder *cylinderNode)
         // Fix me
         Disk *bottom = NULL;
         cylinder->createBottom(&bottom);
-        bottom->setMaterial(gVisitor.material);
-        gVisitor.tranformObject(bottom);
-        gVisitor.scene->addObject(bottom);
-        gVisitor.scene->diskCount++;
+        bottom->setMaterial(gVisitor->material);
+        gVisitor->tranformObject(bottom);
+        gVisitor->scene->addObject(bottom);
+        gVisitor->scene->diskCount++;
     }
-    gVisitor.addObject(cylinder);
-    gVisitor.scene->cylinderCount++;
+    gVisitor->addObject(cylinder);
+    gVisitor->scene->cylinderCount++;
 }
 
 void MyVisitor::enterX3DCutPlaneNode(X3D::CutPlane *cutPlaneNode)
@@ -671,43 +1174,132 @@ void MyVisitor::enterX3DCutPlaneNode(X3D::CutPlane *cutPlaneNode)
     Point3D anchor(a.x, a.y, a.z);
     Point3D normal(d.x,d.y, d.z);
     Plane *plane = new Plane(anchor, normal);
-    gVisitor.tranformObject(plane);
-    gVisitor.planeList.push_back(plane);
-    gVisitor.scene->cutPlaneCount++;
+    gVisitor->tranformObject(plane);
+    gVisitor->planeList.push_back(plane);
+    gVisitor->scene->cutPlaneCount++;
 }
 
-Point3D gVertexTable[3];
+// Outline in the z = 0 plane turning one way and only once around, what
+// PolygonD can take
+static bool isFlatConvex(const std::vector<Point3D> &points)
+{
+    U32 count = (U32) points.size();
+    F64 turning = 0.0;
+    bool left = true;
+    bool right = true;
+    
+    for (U32 i = 0; i < count; i++)
+    {
+        const Point3D &p1 = points[i];
+        const Point3D &p2 = points[(i + 1) % count];
+        const Point3D &p3 = points[(i + 2) % count];
+        
+        if (p1.z != 0.0)
+            return false;
+        
+        F64 u1 = p2.x - p1.x, v1 = p2.y - p1.y;
+        F64 u2 = p3.x - p2.x, v2 = p3.y - p2.y;
+        F64 turn = u1 * v2 - v1 * u2;
+        
+        left = left && turn >= 0.0;
+        right = right && turn <= 0.0;
+        turning += atan2(turn, u1 * u2 + v1 * v2);
+    }
+    return (left || right) && fabs(fabs(turning) - 2 * PI) < 0.5;
+}
 
 void MyVisitor::enterX3DPolygonNode(X3D::Polygon *polygonNode)
 {
-    gVertexTable[0].set(0.0, 0.0, 0.0);
-    gVertexTable[1].set(1.0, 0.0, 0.0);
-    gVertexTable[2].set(1.0, -1.0, 0.0);
-    //PolygonD *poly = new PolygonD();
-    Triangle *poly = new Triangle(gVertexTable, 0, 1, 2);
     const MFVec3f& points = polygonNode->getPoints();
+    std::vector<Point3D> vertices;
+    std::vector<U32> face;
     
-    /*for (MFVec3f::const_iterator walk = points.begin(); walk != points.end(); walk++)
-     {
-     const SFVec3f p = *walk;
-     poly->addVertex(Point3D(p.x, p.y, p.z));
-     }*/
-    //poly->preInitialize();
-    gVisitor.addObject(poly);
-    //poly->initialize();
-    //assert(poly->isInitialized());
-    gVisitor.scene->polygonCount++;
-    
-    /*   poly->preInitialize();
-     std::vector<MatrixD*>* vector = &gVisitor.textureMatrixList;
-     
-     if (poly && vector->size() > 0)
-     {
-     for (std::vector<MatrixD*>::const_reverse_iterator walk = vector->rbegin(); walk != vector->rend(); walk++)
-     {
-     poly->transformUV(**walk);
-     }
-     }*/
+    for (MFVec3f::const_iterator walk = points.begin(); walk != points.end(); walk++)
+    {
+        face.push_back((U32) vertices.size());
+        vertices.push_back(Point3D(walk->x, walk->y, walk->z));
+    }
+    gVisitor->scene->polygonCount++;
+    
+    if (face.size() < 3)
+        return;
+    
+    // Convex polygons are tested as they are and mapped through the rectangle
+    // bounding them
+    if (isFlatConvex(vertices))
+    {
+        PolygonD *poly = new PolygonD();
+        
+        for (std::vector<Point3D>::const_iterator walk = vertices.begin(); walk != vertices.end(); walk++)
+            poly->addVertex(*walk);
+        poly->preInitialize();
+        gVisitor->addObject(poly);
+        poly->initialize();
+        return;
+    }
+    
+    // The others may be concave, they load as one object so the triangles
+    // don't share the cut planes of the shape
+    TriangleMesh *mesh = new TriangleMesh();
+    bool flat = true;
+    
+    for (std::vector<Point3D>::const_iterator walk = vertices.begin(); walk != vertices.end(); walk++)
+    {
+        mesh->addVertex(*walk);
+        flat = flat && walk->z == 0.0;
+    }
+    mesh->addFace(&face[0], (U32) face.size(), false);
+    
+    // Only outlines in z = 0 have a texture frame, as for PolygonD
+    if (flat)
+        mesh->setTextureOutline(vertices);
+    gVisitor->addMesh(mesh);
+}
+
+void MyVisitor::enterX3DIndexedFaceSetNode(X3D::IndexedFaceSet *faceSetNode)
+{
+    TriangleMesh *mesh = createMesh(faceSetNode->getCoord());
+    
+    if (!mesh)
+        return;
+    
+    // Faces are separated by -1, the last one may not be terminated
+    const MFInt32 &coordIndex = faceSetNode->getCoordIndex();
+    bool convex = faceSetNode->getConvex();
+    std::vector<U32> face;
+    
+    for (MFInt32::const_iterator walk = coordIndex.begin(); ; walk++)
+    {
+        if (walk == coordIndex.end() || *walk < 0)
+        {
+            if (!face.empty())
+                mesh->addFace(&face[0], (U32) face.size(), convex);
+            face.clear();
+            
+            if (walk == coordIndex.end())
+                break;
+        }
+        else
+            face.push_back((U32) *walk);
+    }
+    gVisitor->addMesh(mesh);
+}
+
+void MyVisitor::enterX3DIndexedTriangleSetNode(X3D::IndexedTriangleSet *triangleSetNode)
+{
+    TriangleMesh *mesh = createMesh(triangleSetNode->getCoord());
+    
+    if (!mesh)
+        return;
+    
+    const MFInt32 &index = triangleSetNode->getIndex();
+    
+    for (U32 i = 0; i + 2 < index.size(); i += 3)
+    {
+        if (index[i] >= 0 && index[i + 1] >= 0 && index[i + 2] >= 0)
+            mesh->addTriangle(index[i], index[i + 1], index[i + 2]);
+    }
+    gVisitor->addMesh(mesh);
 }
 
 void MyVisitor::enterX3DQuadricSurfaceNode(X3D::QuadricSurface* quadricSurfaceNode)
@@ -725,8 +1317,8 @@ void MyVisitor::enterX3DQuadricSurfaceNode(X3D::QuadricSurface* quadricSurfaceNo
                                                   quadricSurfaceNode->K);
     //disk->setBounds(diskNode->getWidthLeft(), diskNode->getWidthRight(), diskNode->getHeightBottom(), diskNode->getHeightTop());
     qSurface->setBounds(11.5, 11.5, 11.5, 11.5);
-    gVisitor.addObject(qSurface);
-    gVisitor.scene->quadricCount++;
+    gVisitor->addObject(qSurface);
+    gVisitor->scene->quadricCount++;
 }
 
 
@@ -734,38 +1326,43 @@ void MyVisitor::enterX3DDiskNode(X3D::Disk* diskNode)
 {
     Disk * disk = new Disk(diskNode->getOuterRadius(), diskNode->getAnti() != 0.0);
     disk->setBounds(diskNode->getWidthLeft(), diskNode->getWidthRight(), diskNode->getHeightBottom(), diskNode->getHeightTop());
-    gVisitor.addObject(disk);
-    gVisitor.scene->diskCount++;
+    gVisitor->addObject(disk);
+    gVisitor->scene->diskCount++;
 }
 
 void MyVisitor::leaveX3DShapeNode(X3D::Shape*)
 {
-    gVisitor.planeList.clear();
-    gVisitor.texture = NULL;
-    gVisitor.bumpMap = NULL;
-    gVisitor.opacityMap = NULL;
-    if (gVisitor.north)
+    gVisitor->planeList.clear();
+    gVisitor->texture = NULL;
+    gVisitor->bumpMap = NULL;
+    gVisitor->opacityMap = NULL;
+    if (gVisitor->north)
     {
-        delete gVisitor.north;
-        gVisitor.north = NULL;
+        delete gVisitor->north;
+        gVisitor->north = NULL;
     }
-    if (gVisitor.greenwich)
+    if (gVisitor->greenwich)
     {
-        delete gVisitor.greenwich;
-        gVisitor.greenwich = NULL;
+        delete gVisitor->greenwich;
+        gVisitor->greenwich = NULL;
     }
 }
 
-void Scene::load(const char *filename)
+void Scene::load(const char *filename, bool useCache)
 {
+    if (useCache && readCache(filename))
+        return;
+    
     X3D::Loader loader;
-    SceneProcessor sp;
+    SceneProcessor sp(this);
     MemReleaser releaser;
     //  GraphTester tester;
     
-    gVisitor.scene = this;
     X3D::Scene *s = loader.load(filename, false);
     sp.process(s);
+    buildAccelerator();
+    if (useCache)
+        writeCache(filename);
     //  X3D::Scene *s = loader.load("c:/dino.x3d", false);  
     //  SceneWalker *myWalker = new SceneWalker();
     //  tester.setWalker(myWalker);
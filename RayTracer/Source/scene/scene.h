@@ -15,24 +15,52 @@
 #include "core/color.h"
 #endif
 
+#ifndef _REFOBJECT_H_
+#include "core/refObject.h"
+#endif
+
 #ifndef _LIGHT_H_
 #include "scene/light.h"
 #endif
 
+#ifndef _BVH_H_
+#include "scene/bvh.h"
+#endif
+
+#ifndef _LIGHTINDEX_H_
+#include "scene/lightIndex.h"
+#endif
+
+#ifndef _TEXTURECACHE_H_
+#include "scene/textureCache.h"
+#endif
+
+#ifndef _TRIANGLE_H_
+#include "scene/triangle.h"
+#endif
+
+#ifndef _PRIMITIVEPOOL_H_
+#include "scene/primitivePool.h"
+#endif
+
 #include "math/math.h"
 
 class Bitmap;
-class Ray;
 class Plane;
 class PolygonD;
 class IntersectionList;
+class MemStream;
+class SceneStream;
 
-class Texture
+class Texture : public RefObject
 {
 public:
     void getTexel(U32 i, U32 j, ColorF &color) const;
     void getTexel(U32 i, U32 j, U8* red, U8* blue, U8* green, U8* alpha) const;
     
+    void write(MemStream &stream) const;
+    bool read(MemStream &stream);
+    
     Bitmap bitmap;
     U32 hTile;
     U32 vTile;
@@ -40,9 +68,12 @@ public:
     U32 vTileSize;
 };
 
-class Map
+class Map : public RefObject
 {
 public:
+    void write(MemStream &stream) const;
+    bool read(MemStream &stream);
+    
     U32 height;
     U32 width;
     U32 hTile;
@@ -51,6 +82,26 @@ public:
     U32 vTileSize;
 };
 
+class BumpMap;
+
+// Slopes of a bump map, built once so the normal perturbation reads one texel
+// instead of four heights
+class DerivativeMap
+{
+public:
+    DerivativeMap();
+    ~DerivativeMap();
+    
+    void init(const BumpMap &bumpMap);
+    // Half the height difference between the texels on either side of (i, j),
+    // k1 across i and k2 across j
+    void getSlopes(U32 i, U32 j, F32 &k1, F32 &k2) const;
+    
+private:
+    U32 mWidth;
+    F32 *mSlopes;   // k1 and k2 of every texel
+};
+
 class BumpMap : public Map
 {
 public:
@@ -61,11 +112,19 @@ public:
     void init(Texture *texture, F32 minWidth, F32 maxHeight);
     F32 getHeight(U32 i, U32 j) const;
     void setHeight(U32 i, U32 j, F32 height);
+    // Built by init() and read() from the heights
+    const DerivativeMap& getDerivatives() const { return mDerivatives; }
+    
+    void write(MemStream &stream) const;
+    bool read(MemStream &stream);
     
 private:
     F32 mMinHeight;
     F32 mMaxHeight;
-    F32 *mHeights;
+    F32 mStep;              // Height of one level
+    // 16-bit levels over [mMinHeight, mMaxHeight]
+    U16 *mHeights;
+    DerivativeMap mDerivatives;
 };
 
 class NormalMap : public Map
@@ -76,25 +135,55 @@ public:
     virtual ~NormalMap();
     
     void init(Texture *texture);
-    const Point3D& getNormal(U32 i, U32 j) const;
+    Point3D getNormal(U32 i, U32 j) const;
     void setNormal(U32 i, U32 j, const Point3D &normal);
     
+    void write(MemStream &stream) const;
+    bool read(MemStream &stream);
+    
+private:
+    // Octahedral encoding, the normal is projected on the octahedron
+    // |x| + |y| + |z| = 1 and the lower half folded over the upper one. x and y
+    // are left as two 16-bit signed values
+    static U32 encode(const Point3D &normal);
+    static Point3D decode(U32 code);
+    
 private:
-    Point3D *mNormals;
+    U32 *mNormals;
 };
 
+// Opacity flags with their coverage over blocks of 8x8 texels and over the
+// whole map. Only the texels of mixed blocks are looked up one by one, and a
+// map that is all opaque or all transparent needs no lookup at all
 class OpacityMap : public Map
 {
 public:
+    enum Coverage { EMPTY = 0, OPAQUE, MIXED };
+    enum { BLOCK_SHIFT = 3 };
+    
     OpacityMap();
     virtual ~OpacityMap();
     
     void init(Texture *texture, F32 tolerance);
     bool getFlag(U32 i, U32 j) const;
     void setFlag(U32 i, U32 j, bool flag);
+    Coverage getCoverage() const { return (Coverage) mCoverage; }
+    
+    void write(MemStream &stream) const;
+    bool read(MemStream &stream);
+    
+private:
+    U32 getWordCount() const { return (width * height + 31) / 32; }
+    bool getBit(U32 k) const { return (mFlags[k >> 5] & (1 << (k & 31))) != 0; }
+    void buildCoverage();
     
 private:
-    U8* mFlags;
+    // One bit per texel, row after row
+    U32 *mFlags;
+    // Coverage of every block and of the map
+    U8 *mBlocks;
+    U32 mBlockWidth;
+    U8 mCoverage;
 };
 
 class Material
@@ -132,60 +221,120 @@ class SceneObject
 {
 public:
     enum IntersectResult { MISS, HIT };
+    enum Type { SPHERE = 0, PLANE, DISK, CYLINDER, CONE, QUADRIC_SURFACE, POLYGON, TRIANGLE, MESH, TYPE_COUNT };
     
-    SceneObject() : mTexture(NULL), mBumpMap(NULL), mNormalMap(NULL), mOpacityMap(NULL)
-    {
-        mNorth.set(0.0, -1.0, 0.0);
-        mGreenwich.set(0.0, 0.0, -1.0);
-    }
+    SceneObject() : mShading(NULL) {}
+    SceneObject(const Material &material) : mShading(NULL) { setMaterial(material); }
+    // Copy the shading only, cut planes belong to the object they were added to
+    SceneObject(const SceneObject &object);
+    SceneObject& operator=(const SceneObject &object);
+    virtual ~SceneObject();
     
-    SceneObject(const Material &material) : mTexture(NULL), mBumpMap(NULL), mNormalMap(NULL), mOpacityMap(NULL), mMaterial(material) {}
-    ~SceneObject();
+    // Blank object of the given type, for read()
+    static SceneObject* create(Type type);
+    virtual Type getType() const = 0;
     
-    S32 getCutPlaneCount() { return (S32) mCutPlaneList.size(); }
+    S32 getCutPlaneCount() const { return (S32) mCutPlaneList.size(); }
     void addCutPlane(Plane *plane) { mCutPlaneList.push_back(plane); }
-    Plane* getCutPlane(S32 index) { mCutPlaneList[index]; }
+    const Plane* getCutPlane(S32 index) const { return mCutPlaneList[index]; }
     
-    void setMaterial(const Material &material) { mMaterial = material; }
-    const Material &getMaterial() const { return mMaterial; }
+    void setMaterial(const Material &material) { getShading().material = material; }
+    const Material &getMaterial() const { return getShading().material; }
     
-    virtual void setTexture(Texture *texture) { mTexture = texture; }
-    const Texture* getTexture() const { return mTexture; }
+    virtual void setTexture(Texture *texture) { setRef(getShading().texture, texture); }
+    const Texture* getTexture() const { return getShading().texture; }
     
-    virtual void setBumpMap(BumpMap *bumpMap) { mBumpMap = bumpMap; }
-    const BumpMap* getBumpMap() const { return mBumpMap; }
+    virtual void setBumpMap(BumpMap *bumpMap) { setRef(getShading().bumpMap, bumpMap); }
+    const BumpMap* getBumpMap() const { return getShading().bumpMap; }
     
-    virtual void setNormalMap(NormalMap *normalMap) { mNormalMap = normalMap; }
-    const NormalMap* getNormalMap() const { return mNormalMap; }
+    virtual void setNormalMap(NormalMap *normalMap) { setRef(getShading().normalMap, normalMap); }
+    const NormalMap* getNormalMap() const { return getShading().normalMap; }
     
-    virtual void setOpacityMap(OpacityMap *opacityMap) { mOpacityMap = opacityMap; }
-    const OpacityMap* getOpacityMap() const { return mOpacityMap; }
+    virtual void setOpacityMap(OpacityMap *opacityMap) { setRef(getShading().opacityMap, opacityMap); }
+    const OpacityMap* getOpacityMap() const { return getShading().opacityMap; }
     
-    void setNorth(const Point3D &north) { mNorth = north; }
-    const Point3D& getNorth() const { return mNorth; }
+    void setNorth(const Point3D &north) { getShading().north = north; }
+    const Point3D& getNorth() const { return getShading().north; }
     
-    void setGeenwich(const Point3D &greenwich) { mGreenwich = greenwich; }
-    const Point3D& getGreenwich() const { return mGreenwich; }
+    void setGeenwich(const Point3D &greenwich) { getShading().greenwich = greenwich; }
+    const Point3D& getGreenwich() const { return getShading().greenwich; }
+    
+    // World space bounds, tightened by the cut planes. Only valid once transform()
+    // has been applied. Returns false if the object has an infinite extent and
+    // leaves an empty box if the cut planes remove the whole object
+    bool getBounds(Box3D &box) const;
     
     virtual PointUV getUV(const Point3D &point, const Point3D &normal) const { return PointUV(); }
     virtual Point3D getNormal(const Point3D &point) const = 0 ;
     virtual IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const = 0;
+    // Objects made of many primitives, like meshes, tell which one was hit so
+    // the normal doesn't have to be searched for. The others only have 0
+    virtual IntersectResult intersectPrimitive(const Ray& ray, F64 &distance, U32 &primitive) const { primitive = 0; return intersect(ray, distance); }
+    virtual Point3D getPrimitiveNormal(const Point3D &point, U32 primitive) const { return getNormal(point); }
+    // intersect() for the lanes of a packet in mask. Returns the lanes hit,
+    // their distance is updated like intersect() does ray by ray
+    virtual U32 intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const;
+    // intersect() with the alpha test of the opacity map run on each hit as it
+    // is found. Hits on transparent texels are skipped and the object asked for
+    // its next hit past them, the closest opaque hit is returned
+    IntersectResult intersectOpaque(const Ray& ray, F64 &distance) const;
+    IntersectResult intersectOpaque(const Ray& ray, F64 &distance, U32 &primitive) const;
     virtual void perturbNormal(Point3D &normal, const U32 i, const U32 j) const { }
     
     virtual void transform(const MatrixD &m);
     virtual void transformUV(const MatrixD &m);
+    
+    // Scene cache. Objects are stored after transform(), subclasses write
+    // their parent first
+    virtual void write(SceneStream &stream) const;
+    virtual bool read(SceneStream &stream);
 protected:
-    void processIntersection(const Ray& ray, F64 t, IntersectResult &res, F64 &distance, IntersectionList *list) const;
-    bool isInsideCutPlane(const Ray& ray, F64 distance) const;
+    // Cut planes owned through the list are referenced by their index
+    void writeCutPlane(SceneStream &stream, const Plane *plane) const;
+    Plane* readCutPlane(SceneStream &stream) const;
+    
+    virtual bool getExtent(Box3D &box) const { return false; }
+    // Hits are kept when t is within the interval (lo, hi) of the ray left
+    // by the cut planes
+    void processIntersection(F64 t, F64 lo, F64 hi, IntersectResult &res, F64 &distance, IntersectionList *list) const;
+    void processIntersection(U32 lane, F64 t, const F64 *lo, const F64 *hi, U32 &hits, F64 *distance) const;
+    // Clips the ray to the side of every cut plane the object is kept on,
+    // starting from (EPSILON, F64_MAX). Returns false when nothing is left and
+    // the object can't be hit
+    bool clipToCutPlanes(const Ray& ray, F64 &lo, F64 &hi) const;
+    // Same for the lanes of a packet in mask, returns the lanes left
+    U32 clipToCutPlanes(const RayPacket &packet, U32 mask, F64 *lo, F64 *hi) const;
+private:
+    // Only read once the object is hit, kept out of the object so intersecting
+    // it doesn't pull the material and maps into the cache. Objects that are
+    // never shaded, like cut planes, don't get one
+    class Shading
+    {
+    public:
+        Shading() : texture(NULL), bumpMap(NULL), normalMap(NULL), opacityMap(NULL)
+        {
+            north.set(0.0, -1.0, 0.0);
+            greenwich.set(0.0, 0.0, -1.0);
+        }
+        
+        Material material;
+        Texture *texture;
+        BumpMap *bumpMap;
+        NormalMap *normalMap;
+        OpacityMap *opacityMap;
+        Point3D north;
+        Point3D greenwich;
+    };
+    
+    Shading& getShading();
+    const Shading& getShading() const { return (mShading)? *mShading : smDefaultShading; }
+    void copyShading(const SceneObject &object);
+    void releaseShading();
+    
 private:
-    Material mMaterial;
-    Texture *mTexture;
-    BumpMap *mBumpMap;
-    NormalMap *mNormalMap;
-    OpacityMap *mOpacityMap;
-    Point3D mNorth;
-    Point3D mGreenwich;
+    static const Shading smDefaultShading;
     
+    Shading *mShading;
     std::vector<Plane*> mCutPlaneList;
 };
 
@@ -199,10 +348,18 @@ public:
     PointUV getUV(const Point3D &point, const Point3D &normal) const;
     Point3D getNormal(const Point3D &point) const;
     IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    U32 intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const;
+    bool getExtent(Box3D &box) const;
     void perturbNormal(Point3D &normal, const U32 i, const U32 j) const;
     
     void transform(const MatrixD &m);
+    
+    Type getType() const { return SPHERE; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
 private:
+    friend class PrimitivePool;
+    
     Point3D mCenter;
     F64 mRadius;
     F64 mSquaredRadius;
@@ -216,13 +373,18 @@ public:
     Plane(const Point3D &anchor, const Point3D &normal);
     
     // Normal is the same for every point in the plane
-    Point3D getAnchor() const;
-    Point3D getNormal() const;
+    const Point3D& getAnchor() const { return mAnchor; }
+    const Point3D& getNormal() const { return mNormal; }
     Point3D getNormal(const Point3D &point) const;
     IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    U32 intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const;
     
     void transform(const MatrixD &m);
     
+    Type getType() const { return PLANE; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
+    
     void calculateDistance(const Ray& ray, F64 &distance);
 private:
     Point3D mAnchor;
@@ -247,12 +409,20 @@ public:
     virtual PointUV getUV(const Point3D &point, const Point3D &normal) const;
     virtual Point3D getNormal(const Point3D &point) const;
     virtual IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    virtual U32 intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const;
+    virtual bool getExtent(Box3D &box) const;
     virtual void perturbNormal(Point3D &normal, const U32 i, const U32 j) const;
     
     void transform(const MatrixD &m);
     void transformUV(const MatrixD &m);
     
+    Type getType() const { return DISK; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
+    
 private:
+    friend class PrimitivePool;
+    
     Plane mPlane;
     F64 mRadius;
     F64 mSquaredRadius;
@@ -281,10 +451,15 @@ public:
     PointUV getUV(const Point3D &point, const Point3D &normal) const;
     Point3D getNormal(const Point3D &point) const;
     IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    bool getExtent(Box3D &box) const;
     void perturbNormal(Point3D &normal, const U32 i, const U32 j) const;
     
     void transform(const MatrixD &m);
     
+    Type getType() const { return CYLINDER; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
+    
 private:
     Point3D mAnchor;
     Point3D mDirection;
@@ -307,9 +482,14 @@ public:
     PointUV getUV(const Point3D &point, const Point3D &normal) const;
     Point3D getNormal(const Point3D &point) const;
     IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    bool getExtent(Box3D &box) const;
     void perturbNormal(Point3D &normal, const U32 i, const U32 j) const;
     
     void transform(const MatrixD &m);
+    
+    Type getType() const { return CONE; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
 private:
     Point3D mAnchor;
     Point3D mDirection;
@@ -339,12 +519,49 @@ public:
     PointUV getUV(const Point3D &point, const Point3D &normal) const;
     Point3D getNormal(const Point3D &point) const;
     IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    U32 intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const;
+    bool getExtent(Box3D &box) const;
     void perturbNormal(Point3D &normal, const U32 i, const U32 j) const;
     
     void transform(const MatrixD &m);
     void transformUV(const MatrixD &m);
+    
+    // Shape of the surface in a frame of its own, found by classify()
+    enum Form
+    {
+        GENERAL = 0,    // Anything else, solved from the full matrix
+        SPHERE,
+        ELLIPSOID,
+        CYLINDER,       // Elliptic
+        CONE,           // Elliptic
+        HYPERBOLOID,    // One or two sheets
+        PARABOLOID      // Elliptic or hyperbolic
+    };
+    
+    Form getForm() const { return mForm; }
+    
+    Type getType() const { return QUADRIC_SURFACE; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
+private:
+    // Finds the form and frame of the matrix, done again whenever it changes
+    void classify();
+    // Coefficients of a * t^2 + b * t + c = 0 for the ray S + V * t, for a ray
+    // or the lanes of a packet
+    template <class T>
+    void getCoefficients(const T *S, const T *V, T &a, T &b, T &c) const;
+    
 private:
     MatrixD mMatrix;
+    // Canonical form, the surface is the sum of mScale[i] * x[i]^2 plus
+    // mLinear * x[2] plus mConstant, where x[i] = dot(mAxes[i], p - mCenter).
+    // Spheres only use mScale[0] and mCenter
+    Form mForm;
+    Point3D mCenter;
+    Point3D mAxes[3];
+    F64 mScale[3];
+    F64 mLinear;
+    F64 mConstant;
     PolygonD *mTexturePoly;
     F32 mWidthLeft;
     F32 mWidthRight;
@@ -353,6 +570,9 @@ private:
     Plane* mCutPlanes[4];
 };
 
+// Flat convex outline in the z = 0 plane of its object space, the convex
+// polygons of the scene files load as one and the others are triangulated.
+// Disks and quadric surfaces map their textures through one
 class PolygonD : public SceneObject
 {
 public:
@@ -371,20 +591,36 @@ public:
     PointUV getUV(const Point3D &point, const Point3D &normal) const;
     Point3D getNormal(const Point3D &point) const;
     IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    bool getExtent(Box3D &box) const;
     void perturbNormal(Point3D &normal, const U32 i, const U32 j) const;
     
     void transform(const MatrixD &m);
     void transformUV(const MatrixD &m);
+    
+    Type getType() const { return POLYGON; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
 private:
+    // Edge of the projected outline, a * u + b * v + c is positive on its left
+    class Edge
+    {
+    public:
+        F64 a, b, c;
+    };
+    
     void calculatePlane();
     void project();
     void projectPoint(const Point3D &point, PointUV *uvPoint) const;
+    void prepareEdges();
+    bool isInside(const PointUV &point) const;
     
 private:
     enum DropCoord { NONE, X, Y, Z } mDropCoord;
     
     std::vector<Point3D*> mVertexList;
-    std::vector<PointUV*> mUVVertexList;
+    std::vector<PointUV> mUVVertexList;
+    // Counterclockwise, a point is inside when it is left of all of them
+    std::vector<Edge> mEdges;
     Plane *mPlane;
     // Used for texture mapping
     F64 mMaxX;
@@ -401,8 +637,18 @@ private:
 class Triangle : public SceneObject
 {
 public:
+    typedef SceneObject Parent;
+    
+    // Filled by read()
+    Triangle() :
+    mVertexTable(NULL),
+    mP0Index(0),
+    mP1Index(0),
+    mP2Index(0)
+    {
+    }
+    
     Triangle(Point3D *vertexTable, U32 p0Index, U32 p1Index, U32 p2Index) :
-    mPlane(NULL),
     mVertexTable(vertexTable),
     mP0Index(p0Index),
     mP1Index(p1Index),
@@ -411,62 +657,121 @@ public:
         init();
     }
     
-    virtual ~Triangle()
-    {
-        if (mPlane) delete mPlane;
-    }
-    
     virtual PointUV getUV(const Point3D &point, const Point3D &normal) const;
     virtual Point3D getNormal(const Point3D &point) const;
     virtual void perturbNormal(Point3D &normal, const U32 i, const U32 j) const;
     virtual IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    virtual bool getExtent(Box3D &box) const;
+    
+    Type getType() const { return TRIANGLE; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
     
 private:
+    friend class PrimitivePool;
+    
     void init();
     
 private:
-    Plane*   mPlane;
     Point3D* mVertexTable;
     U32      mP0Index;
     U32      mP1Index;
     U32      mP2Index;
-    Point3D  mQ1;
-    Point3D  mQ2;
-    F64      mDotQ1Q1;
-    F64      mDotQ2Q2;
-    F64      mDotQ1Q2;
-    F64      mScalar;
+    Point3D  mNormal;
+};
+
+// Triangles over one shared vertex buffer, with a BVH of their own so a whole
+// mesh is a single scene object. Vertices and faces are added in object space,
+// initialize() prepares the triangles once the mesh has been transformed.
+class TriangleMesh : public SceneObject
+{
+public:
+    typedef SceneObject Parent;
+    
+    TriangleMesh() : mTexturePoly(NULL) {}
+    virtual ~TriangleMesh();
+    
+    // Index of the vertex for addTriangle() and addFace()
+    U32 addVertex(const Point3D &vertex);
+    void addTriangle(U32 p0Index, U32 p1Index, U32 p2Index);
+    // Triangles of a face of count vertices, a fan when it is known to be
+    // convex and ear clipped otherwise
+    void addFace(const U32 *indices, U32 count, bool convex);
+    void initialize();
+    bool isInitialized() const { return mTriangles.getCount() * 3 == mIndices.size(); }
+    // Maps the texture through the rectangle bounding the outline, like a
+    // PolygonD does. The points are in object space, in the z = 0 plane
+    void setTextureOutline(const std::vector<Point3D> &outline);
+    
+    U32 getVertexCount() const { return (U32) mVertices.size(); }
+    U32 getTriangleCount() const { return (U32) (mIndices.size() / 3); }
+    
+    virtual Point3D getNormal(const Point3D &point) const;
+    virtual IntersectResult intersect(const Ray& ray, F64 &distance, IntersectionList *list = NULL) const;
+    // The primitive is the index of the triangle hit
+    virtual IntersectResult intersectPrimitive(const Ray& ray, F64 &distance, U32 &primitive) const;
+    virtual Point3D getPrimitiveNormal(const Point3D &point, U32 primitive) const;
+    virtual PointUV getUV(const Point3D &point, const Point3D &normal) const;
+    virtual void setBumpMap(BumpMap *bumpMap);
+    virtual void perturbNormal(Point3D &normal, const U32 i, const U32 j) const;
+    virtual bool getExtent(Box3D &box) const;
+    virtual void transform(const MatrixD &m);
+    virtual void transformUV(const MatrixD &m);
+    
+    Type getType() const { return MESH; }
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
+    
+private:
+    class HitVisitor;
+    class PointVisitor;
+    
+    // What addFace() adds, three indices per triangle appended to triangles
+    static void triangulate(const Point3D *vertices, const U32 *indices, U32 count, bool convex, std::vector<U32> &triangles);
+    // Triangle that point lies on, for getNormal() callers that don't know
+    // which one was hit
+    U32 findTriangle(const Point3D &point) const;
+    Point3D getTriangleNormal(U32 triangle) const;
+    
+private:
+    std::vector<Point3D> mVertices;
+    // Three per triangle, in the BVH order once initialized
+    std::vector<U32> mIndices;
+    // Vertices of the triangles in the order of the BVH leaves
+    TriangleArray mTriangles;
+    BVH mBVH;
+    Box3D mBounds;
+    // Texture frame, meshes loaded from a polygon only
+    PolygonD *mTexturePoly;
 };
 
+// Hits along a ray sorted by distance, nearest first. The storage is part of
+// the list so adding hits never allocates, once full the farthest are dropped.
 class IntersectionList
 {
 public:
-    class IntersectionListNode
+    enum { CAPACITY = 32 };
+    
+    class Intersection
     {
     public:
-        friend class IntersectionList;
-        
-        const SceneObject* getObject() { return mObj; }
-        F64 getDistance() { return mDistance; }
-        
-        IntersectionListNode* getNext() { return mNext; }
-        
-    private:
-        IntersectionListNode * mNext;
-        const SceneObject *mObj;
-        F64 mDistance;
+        const SceneObject *obj;
+        F64 distance;
     };
     
-    IntersectionList() : mFirst(NULL) {};
-    ~IntersectionList();
+    IntersectionList() : mCount(0) {};
+    
+    U32 getCount() const { return mCount; }
+    bool isEmpty() const { return mCount == 0; }
+    const SceneObject* getObject(U32 index) const { return mItems[index].obj; }
+    F64 getDistance(U32 index) const { return mItems[index].distance; }
     
-    IntersectionListNode* getFirst() { return mFirst; }
     void add(const SceneObject *obj, F64 distance);
-    void pop();
-    void clear();
+    void clear() { mCount = 0; }
     
 private:
-    IntersectionListNode *mFirst;
+    Intersection mItems[CAPACITY];
+    U32 mCount;
 };
 
 class Scene
@@ -474,29 +779,48 @@ class Scene
 public:
     Scene()
     {
-        transformationCount = 0;
-        polygonCount        = 0;
-        cutPlaneCount       = 0;
-        cylinderCount       = 0;
-        diskCount           = 0;
-        sphereCount         = 0;
-        quadricCount        = 0;
+        resetCounts();
     }
     virtual ~Scene();
     
     void addLight(PointLight *light) { mLightList.push_back(light); }
-    const PointLight* getLight(S32 index) { return mLightList[index]; }
-    size_t getLightCount() { return mLightList.size(); }
+    const PointLight* getLight(S32 index) const { return mLightList[index]; }
+    size_t getLightCount() const { return mLightList.size(); }
+    // Lights that can reach point, see LightIndex
+    const std::vector<U32>& findLights(const Point3D &point) const { return mLightIndex.find(point); }
+    F32 getLightRange(U32 index) const { return mLightIndex.getRange(index); }
     
     void addObject(SceneObject *object) { mObjList.push_back(object); }
-    
-    const SceneObject* findClosestIntersection(const Ray &ray, Point3D &intersection, Point3D &normal, PointUV &uv, F64 &distance);
-    void findIntersections(const Ray &ray, IntersectionList &list);
-    
-    void load(const char* filename);
+    // Vertices shared by the triangles of the scene, released with it
+    Point3D* createVertexTable(U32 count);
+    TextureCache& getTextureCache() { return mTextureCache; }
+    
+    // The queries only read the scene, they can run concurrently once it is loaded
+    const SceneObject* findClosestIntersection(const Ray &ray, Point3D &intersection, Point3D &normal, PointUV &uv, F64 &distance) const;
+    // Closest object for each ray of the packet, NULL on a miss. distance has
+    // a value for every lane and is updated for the lanes in the packet mask.
+    // Packets that aren't coherent are traced ray by ray
+    void findClosestIntersections(const RayPacket &packet, const SceneObject **objects, U32 *primitives, F64 *distance) const;
+    // Point, normal and UVs of a hit on primitive of obj found at distance
+    // along the ray
+    void getSurface(const SceneObject *obj, U32 primitive, const Ray &ray, F64 distance, Point3D &intersection, Point3D &normal, PointUV &uv) const;
+    void findIntersections(const Ray &ray, IntersectionList &list) const;
+    // Fraction of the light that travels maxDistance along the ray, the product
+    // of the translucency of every surface crossed. Zero if something opaque
+    // is in the way
+    F32 occlusion(const Ray &ray, F64 maxDistance) const;
+    
+    // With useCache the loaded scene is also written to filename.cache and read
+    // back from it on the next load, as long as neither the X3D file nor the
+    // textures it uses have changed since
+    void load(const char* filename, bool useCache = true);
+    void buildAccelerator();
+    
+    bool readCache(const char *filename);
+    bool writeCache(const char *filename) const;
     
     void setViewpoint(const Point3D &viewpoint) { mViewpoint = viewpoint; }
-    const Point3D& getViewpoint() { return mViewpoint; }
+    const Point3D& getViewpoint() const { return mViewpoint; }
 public:
     S32 transformationCount;
     S32 polygonCount;
@@ -506,19 +830,34 @@ public:
     S32 sphereCount;
     S32 coneCount;
     S32 quadricCount;
+    S32 meshCount;
+    S32 triangleCount;
     
 private:
     std::vector<SceneObject*> mObjList;
+    // Objects with infinite extent are kept out of the BVH and always tested
+    std::vector<SceneObject*> mUnboundedList;
+    BVH mBVH;
+    // Geometry of the BVH objects, in the BVH order
+    PrimitivePool mPrimitives;
     std::vector<PointLight*> mLightList;
+    LightIndex mLightIndex;
+    std::vector<Point3D*> mVertexTableList;
+    std::vector<U32> mVertexCountList;
+    TextureCache mTextureCache;
     Point3D mViewpoint;
+    
+private:
+    const SceneObject* findClosestObject(const Ray &ray, F64 &distance, U32 &primitive) const;
+    void clear();
+    void resetCounts();
 };
 
 // Inlines
 
-// Fix me
-inline void SceneObject::processIntersection(const Ray& ray, F64 t, IntersectResult &res, F64 &distance, IntersectionList *list) const
+inline void SceneObject::processIntersection(F64 t, F64 lo, F64 hi, IntersectResult &res, F64 &distance, IntersectionList *list) const
 {
-    if (t > EPSILON && isInsideCutPlane(ray, t))
+    if (t > lo && t < hi)
     {
         if (list) list->add(this, t);
         
@@ -530,6 +869,36 @@ inline void SceneObject::processIntersection(const Ray& ray, F64 t, IntersectRes
     }
 }
 
+inline void SceneObject::processIntersection(U32 lane, F64 t, const F64 *lo, const F64 *hi, U32 &hits, F64 *distance) const
+{
+    if (t > lo[lane] && t < hi[lane] && t < distance[lane])
+    {
+        distance[lane] = t;
+        hits |= 1 << lane;
+    }
+}
+
+// IntersectionList inlines
+
+inline void IntersectionList::add(const SceneObject *obj, F64 distance)
+{
+    S32 i = (S32) mCount;
+    
+    if (mCount < CAPACITY)
+        mCount++;
+    else if (distance >= mItems[CAPACITY - 1].distance)
+        return;
+    else
+        i--;
+    
+    // Shift farther hits up to keep the list sorted
+    for (; i > 0 && mItems[i - 1].distance > distance; --i)
+        mItems[i] = mItems[i - 1];
+    
+    mItems[i].obj = obj;
+    mItems[i].distance = distance;
+}
+
 // Texture inlines
 
 inline void Texture::getTexel(U32 i, U32 j, ColorF &color) const
@@ -562,37 +931,105 @@ inline F32 BumpMap::getHeight(U32 i, U32 j) const
         j = 0;
     if (j >= height)
         j = height - 1;
-    //return *(mHeights + (j * (width * 4)) + (i * 4));
-    return *(mHeights + j * width + i);
+    return mMinHeight + *(mHeights + j * width + i) * mStep;
 }
 
 inline void BumpMap::setHeight(U32 i, U32 j, F32 height)
 {
-    *(mHeights + j * width + i) = height;
+    F32 level = (mStep > 0.0f)? (height - mMinHeight) / mStep + 0.5f : 0.0f;
+    
+    if (level < 0.0f)
+        level = 0.0f;
+    if (level > 65535.0f)
+        level = 65535.0f;
+    *(mHeights + j * width + i) = U16(level);
+}
+
+// DerivativeMap inlines
+
+inline void DerivativeMap::getSlopes(U32 i, U32 j, F32 &k1, F32 &k2) const
+{
+    const F32 *slopes = mSlopes + 2 * (j * mWidth + i);
+    k1 = slopes[0];
+    k2 = slopes[1];
 }
 
 // OpacityMap inlines
 
 inline bool OpacityMap::getFlag(U32 i, U32 j) const
 {
-    return *(mFlags + j * width + i) != 0;
+    U8 block = mBlocks[(j >> BLOCK_SHIFT) * mBlockWidth + (i >> BLOCK_SHIFT)];
+    
+    if (block != MIXED)
+        return block == OPAQUE;
+    return getBit(j * width + i);
 }
 
 inline void OpacityMap::setFlag(U32 i, U32 j, bool flag)
 {
-    *(mFlags + j * width + i) = (flag)? 1 : 0;
+    U32 k = j * width + i;
+    
+    if (flag)
+        mFlags[k >> 5] |= 1 << (k & 31);
+    else
+        mFlags[k >> 5] &= ~(1 << (k & 31));
+    
+    // Until buildCoverage() runs again
+    if (mBlocks)
+    {
+        mBlocks[(j >> BLOCK_SHIFT) * mBlockWidth + (i >> BLOCK_SHIFT)] = MIXED;
+        mCoverage = MIXED;
+    }
 }
 
 // NormalMap inlines
 
-inline const Point3D& NormalMap::getNormal(U32 i, U32 j) const
+inline Point3D NormalMap::getNormal(U32 i, U32 j) const
 {
-    return *(mNormals + j * width + i);
+    return decode(*(mNormals + j * width + i));
 }
 
 inline void NormalMap::setNormal(U32 i, U32 j, const Point3D &normal)
 {
-    *(mNormals + j * width + i) = normal;
+    *(mNormals + j * width + i) = encode(normal);
+}
+
+inline U32 NormalMap::encode(const Point3D &normal)
+{
+    F64 l1 = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+    F64 x = normal.x / l1;
+    F64 y = normal.y / l1;
+    
+    if (normal.z < 0.0)
+    {
+        F64 fx = (1.0 - fabs(y)) * ((x >= 0.0)? 1.0 : -1.0);
+        F64 fy = (1.0 - fabs(x)) * ((y >= 0.0)? 1.0 : -1.0);
+        x = fx;
+        y = fy;
+    }
+    
+    S16 u = S16(floor(x * 32767.0 + 0.5));
+    S16 v = S16(floor(y * 32767.0 + 0.5));
+    return U32(U16(u)) | (U32(U16(v)) << 16);
+}
+
+inline Point3D NormalMap::decode(U32 code)
+{
+    F64 x = S16(code & 0xffff) / 32767.0;
+    F64 y = S16(code >> 16) / 32767.0;
+    F64 z = 1.0 - fabs(x) - fabs(y);
+    
+    if (z < 0.0)
+    {
+        F64 fx = (1.0 - fabs(y)) * ((x >= 0.0)? 1.0 : -1.0);
+        F64 fy = (1.0 - fabs(x)) * ((y >= 0.0)? 1.0 : -1.0);
+        x = fx;
+        y = fy;
+    }
+    
+    Point3D normal(x, y, z);
+    normal.normalize();
+    return normal;
 }
 
 
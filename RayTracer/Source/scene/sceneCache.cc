@@ -0,0 +1,286 @@
+#include <string.h>
+#include <string>
+#include "core/file.h"
+#include "core/memStream.h"
+#include "scene/scene.h"
+#include "scene/sceneStream.h"
+
+// Binary snapshot of a loaded scene, written next to the X3D file. Objects are
+// stored after their transforms and the BVH as built, so reading the cache
+// skips the X3D parser, the image decoding and the BVH build. Any change in
+// the layout of the stored classes must bump the version.
+
+#define SCENE_CACHE_MAGIC   (0x4e435352) // RSCN
+#define SCENE_CACHE_VERSION (5)
+
+static std::string getCacheName(const char *filename)
+{
+    return std::string(filename) + ".cache";
+}
+
+// Sizes of the classes stored as raw memory, a build with a different layout
+// rejects the cache instead of misreading it
+static void getLayout(U32 layout[5])
+{
+    layout[0] = sizeof(Point3D);
+    layout[1] = sizeof(Material);
+    layout[2] = sizeof(PointLight);
+    layout[3] = sizeof(BVH::Node);
+    layout[4] = sizeof(MatrixD);
+}
+
+void Texture::write(MemStream &stream) const
+{
+    bitmap.write(stream);
+    stream.write(hTile);
+    stream.write(vTile);
+    stream.write(hTileSize);
+    stream.write(vTileSize);
+}
+
+bool Texture::read(MemStream &stream)
+{
+    bitmap.read(stream);
+    stream.read(&hTile);
+    stream.read(&vTile);
+    stream.read(&hTileSize);
+    stream.read(&vTileSize);
+    return stream.isOk();
+}
+
+void Map::write(MemStream &stream) const
+{
+    stream.write(height);
+    stream.write(width);
+    stream.write(hTile);
+    stream.write(vTile);
+    stream.write(hTileSize);
+    stream.write(vTileSize);
+}
+
+bool Map::read(MemStream &stream)
+{
+    stream.read(&height);
+    stream.read(&width);
+    stream.read(&hTile);
+    stream.read(&vTile);
+    stream.read(&hTileSize);
+    stream.read(&vTileSize);
+    return stream.isOk();
+}
+
+bool Scene::writeCache(const char *filename) const
+{
+    SceneStream stream;
+    U32 layout[5];
+    
+    stream.write((U32) SCENE_CACHE_MAGIC);
+    stream.write((U32) SCENE_CACHE_VERSION);
+    getLayout(layout);
+    stream.write(sizeof(layout), layout);
+    
+    // Files the scene was built from, the cache is stale once any of them changes
+    const std::set<std::string> &textureFiles = mTextureCache.getFiles();
+    std::vector<std::string> files(1, filename);
+    files.insert(files.end(), textureFiles.begin(), textureFiles.end());
+    
+    stream.write((U32) files.size());
+    for (std::vector<std::string>::const_iterator walk = files.begin(); walk != files.end(); walk++)
+    {
+        U64 modifiedTime, size;
+        
+        if (!File::getInfo(walk->c_str(), modifiedTime, size))
+            return false;
+        stream.writeString(*walk);
+        stream.write(modifiedTime);
+        stream.write(size);
+    }
+    
+    stream.write(transformationCount);
+    stream.write(polygonCount);
+    stream.write(cutPlaneCount);
+    stream.write(cylinderCount);
+    stream.write(diskCount);
+    stream.write(sphereCount);
+    stream.write(coneCount);
+    stream.write(quadricCount);
+    stream.write(meshCount);
+    stream.write(triangleCount);
+    stream.write(mViewpoint);
+    
+    stream.write((U32) mLightList.size());
+    for (std::vector<PointLight*>::const_iterator walk = mLightList.begin(); walk != mLightList.end(); walk++)
+        stream.write(**walk);
+    
+    stream.write((U32) mVertexTableList.size());
+    for (U32 i = 0; i < mVertexTableList.size(); i++)
+    {
+        stream.write(mVertexCountList[i]);
+        stream.write(mVertexCountList[i] * sizeof(Point3D), mVertexTableList[i]);
+        stream.addVertexTable(mVertexTableList[i]);
+    }
+    
+    mTextureCache.write(stream);
+    
+    stream.write((U32) mObjList.size());
+    for (std::vector<SceneObject*>::const_iterator walk = mObjList.begin(); walk != mObjList.end(); walk++)
+    {
+        stream.write((U32) (*walk)->getType());
+        (*walk)->write(stream);
+        stream.addObject(*walk);
+    }
+    
+    stream.write((U32) mUnboundedList.size());
+    for (std::vector<SceneObject*>::const_iterator walk = mUnboundedList.begin(); walk != mUnboundedList.end(); walk++)
+        stream.writeObject(*walk);
+    
+    mBVH.write(stream);
+    
+    if (!stream.isOk())
+        return false;
+    
+    File file;
+    
+    if (file.open(getCacheName(filename).c_str(), File::Write) != File::Ok)
+        return false;
+    
+    File::Status status = file.write(stream.getSize(), stream.getData());
+    file.close();
+    return status == File::Ok;
+}
+
+bool Scene::readCache(const char *filename)
+{
+    // Only into an empty scene, a failed read clears it
+    if (!mObjList.empty() || !mLightList.empty())
+        return false;
+    
+    MappedFile file;
+    
+    if (!file.open(getCacheName(filename).c_str()))
+        return false;
+    
+    SceneStream stream(file.getData(), file.getSize());
+    U32 magic = 0, version = 0, count = 0;
+    U32 layout[5], fileLayout[5];
+    
+    stream.read(&magic);
+    stream.read(&version);
+    getLayout(layout);
+    stream.read(sizeof(fileLayout), fileLayout);
+    
+    if (!stream.isOk() || magic != SCENE_CACHE_MAGIC || version != SCENE_CACHE_VERSION ||
+        memcmp(layout, fileLayout, sizeof(layout)) != 0)
+    {
+        return false;
+    }
+    
+    stream.read(&count);
+    for (U32 i = 0; i < count; i++)
+    {
+        std::string path;
+        U64 modifiedTime, size, currentTime, currentSize;
+        
+        stream.readString(path);
+        stream.read(&modifiedTime);
+        stream.read(&size);
+        
+        if (!stream.isOk() || (i == 0 && path != filename))
+            return false;
+        
+        if (!File::getInfo(path.c_str(), currentTime, currentSize) || currentTime != modifiedTime || currentSize != size)
+            return false;
+    }
+    
+    // Counts and viewpoint are read before the body can be checked, a cache
+    // that turns out to be broken must not leave them for the XML load
+    Point3D viewpoint = mViewpoint;
+    
+    stream.read(&transformationCount);
+    stream.read(&polygonCount);
+    stream.read(&cutPlaneCount);
+    stream.read(&cylinderCount);
+    stream.read(&diskCount);
+    stream.read(&sphereCount);
+    stream.read(&coneCount);
+    stream.read(&quadricCount);
+    stream.read(&meshCount);
+    stream.read(&triangleCount);
+    stream.read(&mViewpoint);
+    
+    count = 0;
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.isOk(); i++)
+    {
+        PointLight light;
+        
+        if (stream.read(&light))
+            addLight(new PointLight(light));
+    }
+    
+    count = 0;
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.isOk(); i++)
+    {
+        U32 vertexCount = 0;
+        
+        if (!stream.read(&vertexCount) || U64(vertexCount) * sizeof(Point3D) > stream.getRemaining())
+        {
+            stream.fail();
+            break;
+        }
+        
+        Point3D *vertexTable = createVertexTable(vertexCount);
+        stream.read(vertexCount * sizeof(Point3D), vertexTable);
+        stream.addVertexTable(vertexTable);
+    }
+    
+    mTextureCache.read(stream);
+    
+    count = 0;
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.isOk(); i++)
+    {
+        U32 type = SceneObject::TYPE_COUNT;
+        SceneObject *object = NULL;
+        
+        stream.read(&type);
+        if (type < SceneObject::TYPE_COUNT)
+            object = SceneObject::create((SceneObject::Type) type);
+        
+        if (!object)
+        {
+            stream.fail();
+            break;
+        }
+        
+        object->read(stream);
+        addObject(object);
+        stream.addObject(object);
+    }
+    
+    count = 0;
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.isOk(); i++)
+    {
+        SceneObject *object = stream.readObject();
+        
+        if (object)
+            mUnboundedList.push_back(object);
+        else
+            stream.fail();
+    }
+    
+    mBVH.read(stream);
+    
+    if (!stream.isOk())
+    {
+        clear();
+        resetCounts();
+        mViewpoint = viewpoint;
+        return false;
+    }
+    mPrimitives.build(mBVH.getObjects());
+    mLightIndex.build(mLightList);
+    return true;
+}
\ No newline at end of file
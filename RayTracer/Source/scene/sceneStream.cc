@@ -0,0 +1,42 @@
+#include "scene/sceneStream.h"
+
+void SceneStream::addIndex(const void *pointer, U32 index)
+{
+    mIndices[pointer] = (S32) index;
+}
+
+void SceneStream::addResource(RefObject *resource)
+{
+    addIndex(resource, (U32) mResources.size());
+    mResources.push_back(resource);
+}
+
+void SceneStream::addObject(SceneObject *object)
+{
+    addIndex(object, (U32) mObjects.size());
+    mObjects.push_back(object);
+}
+
+void SceneStream::addVertexTable(Point3D *vertexTable)
+{
+    addIndex(vertexTable, (U32) mVertexTables.size());
+    mVertexTables.push_back(vertexTable);
+}
+
+bool SceneStream::writeIndex(const void *pointer)
+{
+    S32 index = -1;
+    
+    if (pointer)
+    {
+        std::map<const void*, S32>::const_iterator walk = mIndices.find(pointer);
+        
+        if (walk == mIndices.end())
+        {
+            fail();
+            return false;
+        }
+        index = walk->second;
+    }
+    return write(index);
+}
\ No newline at end of file
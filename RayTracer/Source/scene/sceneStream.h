@@ -0,0 +1,61 @@
+#ifndef _SCENESTREAM_H_
+#define _SCENESTREAM_H_
+
+#include <map>
+#include <vector>
+
+#ifndef _MEMSTREAM_H_
+#include "core/memStream.h"
+#endif
+
+#include "math/math.h"
+
+class RefObject;
+class SceneObject;
+
+// Stream for the scene cache. Pointers between scene data are written as
+// indices into tables filled in the same order on both sides: resources from
+// the texture cache, objects and vertex tables. NULL is written as -1.
+class SceneStream : public MemStream
+{
+public:
+    SceneStream() {}
+    SceneStream(const void *data, U32 size) : MemStream(data, size) {}
+    
+    void addResource(RefObject *resource);
+    void addObject(SceneObject *object);
+    void addVertexTable(Point3D *vertexTable);
+    
+    bool writeResource(const RefObject *resource) { return writeIndex(resource); }
+    bool writeObject(const SceneObject *object) { return writeIndex(object); }
+    bool writeVertexTable(const Point3D *vertexTable) { return writeIndex(vertexTable); }
+    
+    RefObject* readResource() { return readPointer(mResources); }
+    SceneObject* readObject() { return readPointer(mObjects); }
+    Point3D* readVertexTable() { return readPointer(mVertexTables); }
+    
+private:
+    void addIndex(const void *pointer, U32 index);
+    bool writeIndex(const void *pointer);
+    
+    template <class T>
+    T* readPointer(const std::vector<T*> &table)
+    {
+        S32 index;
+        
+        if (!read(&index) || index < -1 || index >= (S32) table.size())
+        {
+            fail();
+            return NULL;
+        }
+        return (index < 0)? NULL : table[index];
+    }
+    
+private:
+    std::map<const void*, S32> mIndices;
+    std::vector<RefObject*> mResources;
+    std::vector<SceneObject*> mObjects;
+    std::vector<Point3D*> mVertexTables;
+};
+
+#endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "math/math.h"
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 
 Sphere::Sphere(F64 radius) : mRadius(radius)
 {
@@ -44,6 +45,11 @@ Point3D Sphere::getNormal(const Point3D &point) const
 
 SceneObject::IntersectResult Sphere::intersect(const Ray& ray, F64 &distance, IntersectionList *list) const
 {
+    F64 lo, hi;
+    
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
+    
     const Point3D &S = ray.getOrigin();
     const Point3D &V = ray.getDirection();
     F64 b = dot(V * 2, (S - mCenter));
@@ -57,26 +63,79 @@ SceneObject::IntersectResult Sphere::intersect(const Ray& ray, F64 &distance, In
         F64 t1 = (-b - sqrtD) / 2;
         F64 t2 = (-b + sqrtD) / 2;
         
-        processIntersection(ray, t1, res, distance, list);
-        processIntersection(ray, t2, res, distance, list);
+        processIntersection(t1, lo, hi, res, distance, list);
+        processIntersection(t2, lo, hi, res, distance, list);
     }
     else if (isZero(D))
     {
         F64 t = -b / 2;
-        processIntersection(ray, t, res, distance, list);
+        processIntersection(t, lo, hi, res, distance, list);
     }
     return res;
 }
 
+// Same operations in the same order as intersect(), lane by lane
+U32 Sphere::intersectPacket(const RayPacket &packet, F64 *distance, U32 mask) const
+{
+    F64 lo[RayPacket::SIZE], hi[RayPacket::SIZE];
+    
+    mask = clipToCutPlanes(packet, mask, lo, hi);
+    if (!mask)
+        return 0;
+    
+    PacketF64 two(2.0);
+    PacketF64 Sx = packet.getOrigin(0), Sy = packet.getOrigin(1), Sz = packet.getOrigin(2);
+    PacketF64 Vx = packet.getDirection(0), Vy = packet.getDirection(1), Vz = packet.getDirection(2);
+    PacketF64 Cx(mCenter.x), Cy(mCenter.y), Cz(mCenter.z);
+    
+    PacketF64 b = (Vx * two) * (Sx - Cx) + (Vy * two) * (Sy - Cy) + (Vz * two) * (Sz - Cz);
+    PacketF64 c = (Sx * Sx + Sy * Sy + Sz * Sz) - (Sx * Cx + Sy * Cy + Sz * Cz) * two +
+                  PacketF64(dot(mCenter, mCenter)) - PacketF64(mSquaredRadius);
+    PacketF64 D = b * b - PacketF64(4.0) * c;
+    PacketF64 sqrtD = sqrt(D);
+    
+    U32 twoRoots = (D > PacketF64(0.0)).getBits() & mask;
+    U32 oneRoot = ((D >= PacketF64(-EPSILON)) & (D <= PacketF64(EPSILON))).getBits() & mask & ~twoRoots;
+    
+    if (!(twoRoots | oneRoot))
+        return 0;
+    
+    F64 t1[RayPacket::SIZE], t2[RayPacket::SIZE], t[RayPacket::SIZE];
+    U32 hits = 0;
+    
+    ((-b - sqrtD) / two).store(t1);
+    ((-b + sqrtD) / two).store(t2);
+    (-b / two).store(t);
+    
+    for (U32 lane = 0; lane < RayPacket::SIZE; lane++)
+    {
+        if (twoRoots & (1 << lane))
+        {
+            processIntersection(lane, t1[lane], lo, hi, hits, distance);
+            processIntersection(lane, t2[lane], lo, hi, hits, distance);
+        }
+        else if (oneRoot & (1 << lane))
+            processIntersection(lane, t[lane], lo, hi, hits, distance);
+    }
+    return hits;
+}
+
+bool Sphere::getExtent(Box3D &box) const
+{
+    Point3D r(mRadius, mRadius, mRadius);
+    box.minExtents = mCenter - r;
+    box.maxExtents = mCenter + r;
+    return true;
+}
+
 void Sphere::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
 {
-    const BumpMap *bumpMap = getBumpMap();
     Point3D U;
     cross(normal, getNorth(), &U);
     Point3D V;
     cross(normal, U, &V);
-    F32 k1 =  (bumpMap->getHeight(i-1, j) - bumpMap->getHeight(i+1, j)) / 2;
-    F32 k2 =  (bumpMap->getHeight(i, j-1) - bumpMap->getHeight(i, j+1)) / 2;
+    F32 k1, k2;
+    getBumpMap()->getDerivatives().getSlopes(i, j, k1, k2);
     normal = normal + U * k2 + V * k1;
     normal.normalize();
 }
@@ -85,4 +144,21 @@ void Sphere::transform(const MatrixD &m)
 {
     m.mul(mCenter);
     Parent::transform(m);
+}
+
+void Sphere::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.write(mCenter);
+    stream.write(mRadius);
+    stream.write(mSquaredRadius);
+}
+
+bool Sphere::read(SceneStream &stream)
+{
+    Parent::read(stream);
+    stream.read(&mCenter);
+    stream.read(&mRadius);
+    stream.read(&mSquaredRadius);
+    return stream.isOk();
 }
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include "core/file.h"
+#include "core/refObject.h"
+#include "scene/scene.h"
+#include "scene/sceneStream.h"
+#include "scene/textureCache.h"
+
+TextureCache::TextureCache()
+{
+}
+
+TextureCache::~TextureCache()
+{
+    clear();
+}
+
+void TextureCache::clear()
+{
+    for (std::map<std::string, RefObject*>::iterator walk = mEntries.begin(); walk != mEntries.end(); walk++)
+        walk->second->release();
+    mEntries.clear();
+    mFiles.clear();
+}
+
+std::string TextureCache::getKey(const char *type, const char *path, U32 hTile, U32 vTile, F32 a, F32 b)
+{
+    char params[128];
+    sprintf(params, "%s:%u:%u:%g:%g:", type, hTile, vTile, a, b);
+    return std::string(params) + path;
+}
+
+RefObject* TextureCache::find(const std::string &key) const
+{
+    std::map<std::string, RefObject*>::const_iterator walk = mEntries.find(key);
+    return (walk != mEntries.end())? walk->second : NULL;
+}
+
+void TextureCache::insert(const std::string &key, RefObject *object)
+{
+    object->addRef();
+    mEntries[key] = object;
+}
+
+Texture* TextureCache::load(const char *path, U32 hTile, U32 vTile)
+{
+    Texture *texture = new Texture();
+    File file;
+    
+    mFiles.insert(path);
+    file.open(path, File::Read);
+    texture->bitmap.read(file);
+    texture->hTile = hTile;
+    texture->vTile = vTile;
+    texture->hTileSize = texture->hTile * texture->bitmap.width;
+    texture->vTileSize = texture->vTile * texture->bitmap.height;
+    return texture;
+}
+
+Texture* TextureCache::getTexture(const char *path, U32 hTile, U32 vTile)
+{
+    std::string key = getKey("texture", path, hTile, vTile);
+    Texture *texture = (Texture *) find(key);
+    
+    if (!texture)
+    {
+        texture = load(path, hTile, vTile);
+        insert(key, texture);
+    }
+    return texture;
+}
+
+BumpMap* TextureCache::getBumpMap(const char *path, U32 hTile, U32 vTile, F32 minHeight, F32 maxHeight)
+{
+    std::string key = getKey("bump", path, hTile, vTile, minHeight, maxHeight);
+    BumpMap *bumpMap = (BumpMap *) find(key);
+    
+    if (!bumpMap)
+    {
+        Texture *texture = load(path, hTile, vTile);
+        bumpMap = new BumpMap();
+        bumpMap->init(texture, minHeight, maxHeight);
+        bumpMap->hTile = texture->hTile;
+        bumpMap->vTile = texture->vTile;
+        bumpMap->hTileSize = texture->hTileSize;
+        bumpMap->vTileSize = texture->vTileSize;
+        delete texture;
+        insert(key, bumpMap);
+    }
+    return bumpMap;
+}
+
+NormalMap* TextureCache::getNormalMap(const char *path, U32 hTile, U32 vTile)
+{
+    std::string key = getKey("normal", path, hTile, vTile);
+    NormalMap *normalMap = (NormalMap *) find(key);
+    
+    if (!normalMap)
+    {
+        Texture *texture = load(path, hTile, vTile);
+        normalMap = new NormalMap();
+        normalMap->init(texture);
+        normalMap->hTile = texture->hTile;
+        normalMap->vTile = texture->vTile;
+        normalMap->hTileSize = texture->hTileSize;
+        normalMap->vTileSize = texture->vTileSize;
+        delete texture;
+        insert(key, normalMap);
+    }
+    return normalMap;
+}
+
+OpacityMap* TextureCache::getOpacityMap(const char *path, U32 hTile, U32 vTile, F32 tolerance)
+{
+    std::string key = getKey("opacity", path, hTile, vTile, tolerance);
+    OpacityMap *opacityMap = (OpacityMap *) find(key);
+    
+    if (!opacityMap)
+    {
+        Texture *texture = load(path, hTile, vTile);
+        opacityMap = new OpacityMap();
+        opacityMap->init(texture, tolerance);
+        opacityMap->hTile = texture->hTile;
+        opacityMap->vTile = texture->vTile;
+        opacityMap->hTileSize = texture->hTileSize;
+        opacityMap->vTileSize = texture->vTileSize;
+        delete texture;
+        insert(key, opacityMap);
+    }
+    return opacityMap;
+}
+
+void TextureCache::write(SceneStream &stream) const
+{
+    stream.write((U32) mFiles.size());
+    for (std::set<std::string>::const_iterator walk = mFiles.begin(); walk != mFiles.end(); walk++)
+        stream.writeString(*walk);
+    
+    stream.write((U32) mEntries.size());
+    for (std::map<std::string, RefObject*>::const_iterator walk = mEntries.begin(); walk != mEntries.end(); walk++)
+    {
+        // The key starts with the entry type
+        const std::string &key = walk->first;
+        std::string type = key.substr(0, key.find(':'));
+        
+        stream.writeString(key);
+        if (type == "texture")
+            ((Texture *) walk->second)->write(stream);
+        else if (type == "bump")
+            ((BumpMap *) walk->second)->write(stream);
+        else if (type == "normal")
+            ((NormalMap *) walk->second)->write(stream);
+        else if (type == "opacity")
+            ((OpacityMap *) walk->second)->write(stream);
+        else
+            stream.fail();
+        stream.addResource(walk->second);
+    }
+}
+
+bool TextureCache::read(SceneStream &stream)
+{
+    U32 count = 0;
+    std::string string;
+    
+    clear();
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.readString(string); i++)
+        mFiles.insert(string);
+    
+    count = 0;
+    stream.read(&count);
+    for (U32 i = 0; i < count && stream.readString(string); i++)
+    {
+        std::string type = string.substr(0, string.find(':'));
+        RefObject *object = NULL;
+        
+        if (type == "texture")
+        {
+            Texture *texture = new Texture();
+            texture->read(stream);
+            object = texture;
+        }
+        else if (type == "bump")
+        {
+            BumpMap *bumpMap = new BumpMap();
+            bumpMap->read(stream);
+            object = bumpMap;
+        }
+        else if (type == "normal")
+        {
+            NormalMap *normalMap = new NormalMap();
+            normalMap->read(stream);
+            object = normalMap;
+        }
+        else if (type == "opacity")
+        {
+            OpacityMap *opacityMap = new OpacityMap();
+            opacityMap->read(stream);
+            object = opacityMap;
+        }
+        
+        if (!object)
+            stream.fail();
+        else
+        {
+            insert(string, object);
+            stream.addResource(object);
+        }
+    }
+    return stream.isOk();
+}
\ No newline at end of file
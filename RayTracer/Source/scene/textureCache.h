@@ -0,0 +1,54 @@
+#ifndef _TEXTURECACHE_H_
+#define _TEXTURECACHE_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
+class RefObject;
+class Texture;
+class BumpMap;
+class NormalMap;
+class OpacityMap;
+class SceneStream;
+
+// Textures and maps loaded by a scene, keyed by file path plus the parameters
+// used to build them. Objects share the cached instances and take their own
+// references, the cache holds one until it is cleared.
+class TextureCache
+{
+public:
+    TextureCache();
+    virtual ~TextureCache();
+    
+    Texture* getTexture(const char *path, U32 hTile, U32 vTile);
+    BumpMap* getBumpMap(const char *path, U32 hTile, U32 vTile, F32 minHeight, F32 maxHeight);
+    NormalMap* getNormalMap(const char *path, U32 hTile, U32 vTile);
+    OpacityMap* getOpacityMap(const char *path, U32 hTile, U32 vTile, F32 tolerance);
+    
+    U32 getCount() const { return (U32) mEntries.size(); }
+    // Image files read so far, the scene cache depends on them
+    const std::set<std::string>& getFiles() const { return mFiles; }
+    void clear();
+    
+    // Entries are registered as stream resources in the order they are stored
+    void write(SceneStream &stream) const;
+    bool read(SceneStream &stream);
+    
+private:
+    Texture* load(const char *path, U32 hTile, U32 vTile);
+    static std::string getKey(const char *type, const char *path, U32 hTile, U32 vTile, F32 a = 0.0f, F32 b = 0.0f);
+    
+    RefObject* find(const std::string &key) const;
+    void insert(const std::string &key, RefObject *object);
+    
+private:
+    std::map<std::string, RefObject*> mEntries;
+    std::set<std::string> mFiles;
+};
+
+#endif
\ No newline at end of file
@@ -1,21 +1,12 @@
 #include "scene/scene.h"
+#include "scene/sceneStream.h"
 
 void Triangle::init()
 {
-    mQ1      = mVertexTable[mP1Index] - mVertexTable[mP0Index];
-    mQ2      = mVertexTable[mP2Index] - mVertexTable[mP0Index];
-    mDotQ1Q1 = dot(mQ1, mQ1);
-    mDotQ2Q2 = dot(mQ2, mQ2);
-    mDotQ1Q2 = -dot(mQ1, mQ2);
-    mScalar  = 1 / (mDotQ1Q1 * mDotQ1Q2 - pow(mDotQ1Q2, 2));
+    const Point3D &P0 = mVertexTable[mP0Index];
     
-    if (mPlane == NULL)
-    {
-        Point3D normal;
-        cross(mQ1, mQ2, &normal);
-        normal.normalize();
-        mPlane = new Plane(mVertexTable[mP0Index], normal);
-    }
+    cross(mVertexTable[mP1Index] - P0, mVertexTable[mP2Index] - P0, &mNormal);
+    mNormal.normalize();
 }
 
 PointUV Triangle::getUV(const Point3D &point, const Point3D &normal) const
@@ -25,7 +16,7 @@ PointUV Triangle::getUV(const Point3D &point, const Point3D &normal) const
 
 Point3D Triangle::getNormal(const Point3D &point) const
 {
-    return mPlane->getNormal();
+    return mNormal;
 }
 
 void Triangle::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
@@ -34,29 +25,72 @@ void Triangle::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
 
 SceneObject::IntersectResult Triangle::intersect(const Ray& ray, F64& distance, IntersectionList* list) const
 {
-    F64 t = distance;
-    SceneObject::IntersectResult intersectsPlane = mPlane->intersect(ray, t);
+    IntersectResult res = MISS;
+    F64 lo, hi, t;
+    
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
     
-    if (intersectsPlane)
+    TriangleRay triangleRay(ray);
+    
+    if (triangleRay.intersect(mVertexTable[mP0Index], mVertexTable[mP1Index], mVertexTable[mP2Index], (list)? hi : min(distance, hi), t))
+        processIntersection(t, lo, hi, res, distance, list);
+    return res;
+}
+
+bool Triangle::getExtent(Box3D &box) const
+{
+    box.empty();
+    box.extend(mVertexTable[mP0Index]);
+    box.extend(mVertexTable[mP1Index]);
+    box.extend(mVertexTable[mP2Index]);
+    return true;
+}
+
+void Triangle::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.writeVertexTable(mVertexTable);
+    stream.write(mP0Index);
+    stream.write(mP1Index);
+    stream.write(mP2Index);
+}
+
+bool Triangle::read(SceneStream &stream)
+{
+    Parent::read(stream);
+    mVertexTable = stream.readVertexTable();
+    stream.read(&mP0Index);
+    stream.read(&mP1Index);
+    stream.read(&mP2Index);
+    
+    if (!stream.isOk() || !mVertexTable)
     {
-        const Point3D &S = ray.getOrigin();
-        const Point3D &V = ray.getDirection();
-        Point3D P = S + V * t;
-        Point3D R = P - mVertexTable[mP0Index];
-        F64 dotRQ1 = dot(R, mQ1);
-        F64 dotRQ2 = dot(R, mQ2);
-        F64 w1     = mDotQ2Q2 * dotRQ1 + mDotQ1Q2 * dotRQ2;
-        F64 w2     = mDotQ1Q2 * dotRQ1 + mDotQ1Q1 * dotRQ2;
-        F64 w0     = 1 - w1 - w2;
-        
-        if (w0 >= 0.0 && w1 >= 0.0 && w2 >= 0.0)
-        {
-            if (list) list->add(this, t);
-            distance = t;
-            return HIT;
-            
-        }
+        stream.fail();
+        return false;
     }
+    init();
+    return true;
+}
+
+void TriangleArray::add(const Point3D &a, const Point3D &b, const Point3D &c)
+{
+    const Point3D *vertex[3] = { &a, &b, &c };
     
-    return MISS;
+    for (U32 i = 0; i < 3; i++)
+    {
+        mVertex[i][0].push_back(vertex[i]->x);
+        mVertex[i][1].push_back(vertex[i]->y);
+        mVertex[i][2].push_back(vertex[i]->z);
+    }
 }
+
+void TriangleArray::clear()
+{
+    for (U32 i = 0; i < 3; i++)
+    {
+        mVertex[i][0].clear();
+        mVertex[i][1].clear();
+        mVertex[i][2].clear();
+    }
+}
\ No newline at end of file
@@ -1,3 +1,149 @@
+#ifndef _TRIANGLE_H_
+#define _TRIANGLE_H_
+
+#include <vector>
+
+#ifndef _PLATFORM_H_
+#include "platform/platform.h"
+#endif
+
 #include "math/math.h"
 
+// Watertight ray/triangle test (Woop, Benthin and Wald). The ray is sheared to
+// run along +z, the edge functions are then 2D cross products of the sheared
+// vertices. Two triangles sharing an edge compute it from the same vertices,
+// so a ray can't slip between them. The only division is for the distance of
+// a ray that passed the edge tests.
+class TriangleRay
+{
+public:
+    TriangleRay(const Ray &ray);
+    
+    // Distance to the triangle abc if past EPSILON and closer than distance
+    bool intersect(const Point3D &a, const Point3D &b, const Point3D &c, F64 distance, F64 &t) const;
+    
+public:
+    S32 kx, ky, kz;     // Axes of the sheared space, z is the largest of the direction
+    F64 ox, oy, oz;     // Origin along those axes
+    F64 Sx, Sy, Sz;     // Shear
+};
+
+// Vertices of many triangles as structure of arrays, so four triangles can be
+// tested against one ray at once with the same results as one by one
+class TriangleArray
+{
+public:
+    void add(const Point3D &a, const Point3D &b, const Point3D &c);
+    void clear();
+    
+    U32 getCount() const { return (U32) mVertex[0][0].size(); }
+    Point3D getVertex(U32 index, U32 vertex) const;
+    
+    bool intersect(const TriangleRay &ray, U32 index, F64 distance, F64 &t) const;
+    // Triangles [index, index + 4) at once. Returns the lanes hit, t holds the
+    // distance of every lane
+    U32 intersect4(const TriangleRay &ray, U32 index, F64 distance, F64 *t) const;
+    
+private:
+    // By vertex and axis
+    std::vector<F64> mVertex[3][3];
+};
+
+// Inlines
+
+inline TriangleRay::TriangleRay(const Ray &ray)
+{
+    const Point3D &origin = ray.getOrigin();
+    const Point3D &direction = ray.getDirection();
+    F64 dx = fabs(direction.x), dy = fabs(direction.y), dz = fabs(direction.z);
+    
+    kz = (dx > dy)? ((dx > dz)? 0 : 2) : ((dy > dz)? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    
+    // Keep the winding of the triangles when looking down -z
+    if ((&direction.x)[kz] < 0.0)
+    {
+        S32 k = kx;
+        kx = ky;
+        ky = k;
+    }
+    
+    ox = (&origin.x)[kx];
+    oy = (&origin.x)[ky];
+    oz = (&origin.x)[kz];
+    Sx = (&direction.x)[kx] / (&direction.x)[kz];
+    Sy = (&direction.x)[ky] / (&direction.x)[kz];
+    Sz = 1.0 / (&direction.x)[kz];
+}
+
+inline bool TriangleRay::intersect(const Point3D &a, const Point3D &b, const Point3D &c, F64 distance, F64 &t) const
+{
+    F64 Az = (F64) (&a.x)[kz] - oz;
+    F64 Bz = (F64) (&b.x)[kz] - oz;
+    F64 Cz = (F64) (&c.x)[kz] - oz;
+    F64 Ax = ((F64) (&a.x)[kx] - ox) - Sx * Az;
+    F64 Ay = ((F64) (&a.x)[ky] - oy) - Sy * Az;
+    F64 Bx = ((F64) (&b.x)[kx] - ox) - Sx * Bz;
+    F64 By = ((F64) (&b.x)[ky] - oy) - Sy * Bz;
+    F64 Cx = ((F64) (&c.x)[kx] - ox) - Sx * Cz;
+    F64 Cy = ((F64) (&c.x)[ky] - oy) - Sy * Cz;
+    F64 U = Cx * By - Cy * Bx;
+    F64 V = Ax * Cy - Ay * Cx;
+    F64 W = Bx * Ay - By * Ax;
+    
+    // Inside when the edge functions agree in sign, either winding
+    if ((U < 0.0 || V < 0.0 || W < 0.0) && (U > 0.0 || V > 0.0 || W > 0.0))
+        return false;
+    
+    F64 det = U + V + W;
+    
+    if (det == 0.0)
+        return false;
+    
+    t = ((U * Az + V * Bz + W * Cz) * Sz) / det;
+    return t > EPSILON && t < distance;
+}
+
+inline Point3D TriangleArray::getVertex(U32 index, U32 vertex) const
+{
+    return Point3D(mVertex[vertex][0][index], mVertex[vertex][1][index], mVertex[vertex][2][index]);
+}
+
+inline bool TriangleArray::intersect(const TriangleRay &ray, U32 index, F64 distance, F64 &t) const
+{
+    return ray.intersect(getVertex(index, 0), getVertex(index, 1), getVertex(index, 2), distance, t);
+}
+
+// Same operations as TriangleRay::intersect(), lane by lane
+inline U32 TriangleArray::intersect4(const TriangleRay &ray, U32 index, F64 distance, F64 *t) const
+{
+    PacketF64 ox(ray.ox), oy(ray.oy), oz(ray.oz);
+    PacketF64 Sx(ray.Sx), Sy(ray.Sy);
+    PacketF64 Az = PacketF64(&mVertex[0][ray.kz][index]) - oz;
+    PacketF64 Bz = PacketF64(&mVertex[1][ray.kz][index]) - oz;
+    PacketF64 Cz = PacketF64(&mVertex[2][ray.kz][index]) - oz;
+    PacketF64 Ax = (PacketF64(&mVertex[0][ray.kx][index]) - ox) - Sx * Az;
+    PacketF64 Ay = (PacketF64(&mVertex[0][ray.ky][index]) - oy) - Sy * Az;
+    PacketF64 Bx = (PacketF64(&mVertex[1][ray.kx][index]) - ox) - Sx * Bz;
+    PacketF64 By = (PacketF64(&mVertex[1][ray.ky][index]) - oy) - Sy * Bz;
+    PacketF64 Cx = (PacketF64(&mVertex[2][ray.kx][index]) - ox) - Sx * Cz;
+    PacketF64 Cy = (PacketF64(&mVertex[2][ray.ky][index]) - oy) - Sy * Cz;
+    PacketF64 U = Cx * By - Cy * Bx;
+    PacketF64 V = Ax * Cy - Ay * Cx;
+    PacketF64 W = Bx * Ay - By * Ax;
+    PacketF64 zero(0.0);
+    U32 outside = (((U < zero) | (V < zero) | (W < zero)) & ((U > zero) | (V > zero) | (W > zero))).getBits();
+    PacketF64 det = U + V + W;
+    U32 hits = ((det < zero) | (det > zero)).getBits() & ~outside;
+    
+    if (!hits)
+        return 0;
+    
+    PacketF64 T = ((U * Az + V * Bz + W * Cz) * PacketF64(ray.Sz)) / det;
+    
+    T.store(t);
+    return hits & ((T > PacketF64(EPSILON)) & (T < PacketF64(distance))).getBits();
+}
 
+#endif
\ No newline at end of file
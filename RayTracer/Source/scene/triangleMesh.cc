@@ -0,0 +1,483 @@
+#include "scene/scene.h"
+#include "scene/sceneStream.h"
+
+TriangleMesh::~TriangleMesh()
+{
+    if (mTexturePoly)
+        delete mTexturePoly;
+}
+
+U32 TriangleMesh::addVertex(const Point3D &vertex)
+{
+    mVertices.push_back(vertex);
+    return (U32) mVertices.size() - 1;
+}
+
+void TriangleMesh::addTriangle(U32 p0Index, U32 p1Index, U32 p2Index)
+{
+    U32 count = (U32) mVertices.size();
+    
+    if (p0Index >= count || p1Index >= count || p2Index >= count)
+        return;
+    
+    mIndices.push_back(p0Index);
+    mIndices.push_back(p1Index);
+    mIndices.push_back(p2Index);
+}
+
+void TriangleMesh::addFace(const U32 *indices, U32 count, bool convex)
+{
+    std::vector<U32> triangles;
+    
+    if (count < 3)
+        return;
+    
+    for (U32 i = 0; i < count; i++)
+    {
+        if (indices[i] >= mVertices.size())
+            return;
+    }
+    
+    triangulate(&mVertices[0], indices, count, convex, triangles);
+    mIndices.insert(mIndices.end(), triangles.begin(), triangles.end());
+}
+
+void TriangleMesh::triangulate(const Point3D *vertices, const U32 *indices, U32 count, bool convex, std::vector<U32> &triangles)
+{
+    if (convex || count < 4)
+    {
+        for (U32 i = 2; i < count; i++)
+        {
+            triangles.push_back(indices[0]);
+            triangles.push_back(indices[i - 1]);
+            triangles.push_back(indices[i]);
+        }
+        return;
+    }
+    
+    // Clipped in the coordinate plane the face is most facing, the Newell
+    // normal gives the plane and the winding
+    Point3D normal(0.0, 0.0, 0.0);
+    
+    for (U32 i = 0; i < count; i++)
+    {
+        const Point3D &p = vertices[indices[i]];
+        const Point3D &q = vertices[indices[(i + 1) % count]];
+        
+        normal.x += (p.y - q.y) * (p.z + q.z);
+        normal.y += (p.z - q.z) * (p.x + q.x);
+        normal.z += (p.x - q.x) * (p.y + q.y);
+    }
+    
+    S32 drop = (fabs(normal.x) > fabs(normal.y))? ((fabs(normal.x) > fabs(normal.z))? 0 : 2) : ((fabs(normal.y) > fabs(normal.z))? 1 : 2);
+    S32 u = (drop + 1) % 3;
+    S32 v = (drop + 2) % 3;
+    F64 winding = ((&normal.x)[drop] < 0.0)? -1.0 : 1.0;
+    std::vector<U32> polygon(indices, indices + count);
+    
+    while (polygon.size() > 3)
+    {
+        U32 size = (U32) polygon.size();
+        U32 ear = size;
+        
+        for (U32 i = 0; i < size && ear == size; i++)
+        {
+            const Point3D &a = vertices[polygon[(i + size - 1) % size]];
+            const Point3D &b = vertices[polygon[i]];
+            const Point3D &c = vertices[polygon[(i + 1) % size]];
+            F64 ax = (&a.x)[u], ay = (&a.x)[v];
+            F64 bx = (&b.x)[u], by = (&b.x)[v];
+            F64 cx = (&c.x)[u], cy = (&c.x)[v];
+            
+            // Reflex and flat corners aren't ears
+            if (winding * ((bx - ax) * (cy - ay) - (by - ay) * (cx - ax)) <= 0.0)
+                continue;
+            
+            // Nor are corners with another vertex of the face inside them
+            ear = i;
+            for (U32 j = 0; j < size; j++)
+            {
+                const Point3D &p = vertices[polygon[j]];
+                F64 px = (&p.x)[u], py = (&p.x)[v];
+                
+                if ((px == ax && py == ay) || (px == bx && py == by) || (px == cx && py == cy))
+                    continue;
+                
+                if (winding * ((bx - ax) * (py - ay) - (by - ay) * (px - ax)) >= 0.0 &&
+                    winding * ((cx - bx) * (py - by) - (cy - by) * (px - bx)) >= 0.0 &&
+                    winding * ((ax - cx) * (py - cy) - (ay - cy) * (px - cx)) >= 0.0)
+                {
+                    ear = size;
+                    break;
+                }
+            }
+        }
+        
+        // Self intersecting faces may have no ear left, the rest is fanned
+        if (ear == size)
+            break;
+        
+        triangles.push_back(polygon[(ear + size - 1) % size]);
+        triangles.push_back(polygon[ear]);
+        triangles.push_back(polygon[(ear + 1) % size]);
+        polygon.erase(polygon.begin() + ear);
+    }
+    
+    for (U32 i = 2; i < polygon.size(); i++)
+    {
+        triangles.push_back(polygon[0]);
+        triangles.push_back(polygon[i - 1]);
+        triangles.push_back(polygon[i]);
+    }
+}
+
+void TriangleMesh::setTextureOutline(const std::vector<Point3D> &outline)
+{
+    if (mTexturePoly)
+        delete mTexturePoly;
+    
+    mTexturePoly = new PolygonD();
+    for (std::vector<Point3D>::const_iterator walk = outline.begin(); walk != outline.end(); walk++)
+        mTexturePoly->addVertex(*walk);
+    mTexturePoly->preInitialize();
+}
+
+void TriangleMesh::initialize()
+{
+    std::vector<U32> indices;
+    std::vector<Box3D> bounds;
+    
+    // Triangles without area can't be hit and have no normal
+    indices.reserve(mIndices.size());
+    for (U32 i = 0; i < mIndices.size(); i += 3)
+    {
+        const Point3D &p0 = mVertices[mIndices[i]];
+        Point3D normal;
+        
+        cross(mVertices[mIndices[i + 1]] - p0, mVertices[mIndices[i + 2]] - p0, &normal);
+        if (dot(normal, normal) == 0.0)
+            continue;
+        
+        Box3D box;
+        box.extend(p0);
+        box.extend(mVertices[mIndices[i + 1]]);
+        box.extend(mVertices[mIndices[i + 2]]);
+        bounds.push_back(box);
+        indices.push_back(mIndices[i]);
+        indices.push_back(mIndices[i + 1]);
+        indices.push_back(mIndices[i + 2]);
+    }
+    
+    mBVH.build(bounds);
+    mBounds.empty();
+    
+    // Triangles are stored in the order of the leaves, a leaf is a range of them
+    const std::vector<U32> &order = mBVH.getIndices();
+    
+    mIndices.resize(order.size() * 3);
+    mTriangles.clear();
+    for (U32 i = 0; i < order.size(); i++)
+    {
+        const U32 *source = &indices[order[i] * 3];
+        
+        mIndices[i * 3] = source[0];
+        mIndices[i * 3 + 1] = source[1];
+        mIndices[i * 3 + 2] = source[2];
+        mTriangles.add(mVertices[source[0]], mVertices[source[1]], mVertices[source[2]]);
+        mBounds.extend(bounds[order[i]]);
+    }
+}
+
+// Leaves of the mesh BVH pierced by a ray, four triangles at a time
+class TriangleMesh::HitVisitor
+{
+public:
+    HitVisitor(const TriangleMesh &mesh, const Ray &ray, F64 lo, F64 hi, F64 &distance, IntersectionList *list) :
+        mMesh(mesh), mTriangleRay(ray), mLo(lo), mHi(hi), mDistance(distance), mList(list), result(MISS), triangle(0)
+    {
+    }
+    
+    bool operator()(U32 first, U32 count, F64 &distance)
+    {
+        const TriangleArray &triangles = mMesh.mTriangles;
+        F64 t[PacketF64::SIZE];
+        U32 end = first + count;
+        U32 i = first;
+        
+        for (; i + PacketF64::SIZE <= end; i += PacketF64::SIZE)
+        {
+            U32 hits = triangles.intersect4(mTriangleRay, i, getLimit(), t);
+            
+            for (U32 lane = 0; hits; lane++, hits >>= 1)
+            {
+                if (hits & 1)
+                    process(t[lane], i + lane);
+            }
+        }
+        
+        for (; i < end; i++)
+        {
+            if (triangles.intersect(mTriangleRay, i, getLimit(), t[0]))
+                process(t[0], i);
+        }
+        return false;
+    }
+    
+private:
+    void process(F64 t, U32 i)
+    {
+        F64 closest = mDistance;
+        
+        mMesh.processIntersection(t, mLo, mHi, result, mDistance, mList);
+        if (mDistance < closest)
+            triangle = i;
+    }
+    
+    
+    // Every hit goes to the list, not only the closest
+    F64 getLimit() const { return (mList)? mHi : min(mDistance, mHi); }
+    
+private:
+    const TriangleMesh &mMesh;
+    TriangleRay mTriangleRay;
+    // Interval of the ray left by the cut planes
+    F64 mLo, mHi;
+    F64 &mDistance;
+    IntersectionList *mList;
+    
+public:
+    IntersectResult result;
+    // Closest triangle hit
+    U32 triangle;
+};
+
+SceneObject::IntersectResult TriangleMesh::intersect(const Ray& ray, F64 &distance, IntersectionList *list) const
+{
+    F64 lo, hi;
+    
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
+    
+    HitVisitor visitor(*this, ray, lo, hi, distance, list);
+    
+    // The traversal can't stop at the closest hit when all of them are listed
+    if (list)
+    {
+        F64 maxDistance = hi;
+        mBVH.traverse(ray, maxDistance, visitor);
+    }
+    else
+        mBVH.traverse(ray, distance, visitor);
+    return visitor.result;
+}
+
+SceneObject::IntersectResult TriangleMesh::intersectPrimitive(const Ray& ray, F64 &distance, U32 &primitive) const
+{
+    F64 lo, hi;
+    
+    if (!clipToCutPlanes(ray, lo, hi))
+        return MISS;
+    
+    HitVisitor visitor(*this, ray, lo, hi, distance, NULL);
+    
+    mBVH.traverse(ray, distance, visitor);
+    primitive = visitor.triangle;
+    return visitor.result;
+}
+
+// Triangles of the leaves around a point, keeps the one closest to it. The
+// distance outside of the edges is measured roughly, in barycentric units
+// scaled by the longest edge
+class TriangleMesh::PointVisitor
+{
+public:
+    PointVisitor(const TriangleMesh &mesh, const Point3D &point) :
+        mMesh(mesh), mPoint(point), mBest(F64_MAX), triangle(0)
+    {
+    }
+    
+    bool operator()(U32 first, U32 count)
+    {
+        for (U32 i = first; i < first + count; i++)
+        {
+            Point3D p0 = mMesh.mTriangles.getVertex(i, 0);
+            Point3D edge1 = mMesh.mTriangles.getVertex(i, 1) - p0;
+            Point3D edge2 = mMesh.mTriangles.getVertex(i, 2) - p0;
+            Point3D D = mPoint - p0;
+            Point3D normal;
+            
+            cross(edge1, edge2, &normal);
+            F64 d11 = dot(edge1, edge1);
+            F64 d12 = dot(edge1, edge2);
+            F64 d22 = dot(edge2, edge2);
+            F64 d1 = dot(D, edge1);
+            F64 d2 = dot(D, edge2);
+            F64 area = dot(normal, normal);
+            F64 u = (d22 * d1 - d12 * d2) / area;
+            F64 v = (d11 * d2 - d12 * d1) / area;
+            F64 outside = max(0.0, -u) + max(0.0, -v) + max(0.0, u + v - 1.0);
+            F64 score = fabs(dot(D, normal)) / sqrt(area) + outside * sqrt(max(d11, d22));
+            
+            if (score < mBest)
+            {
+                mBest = score;
+                triangle = i;
+            }
+        }
+        return false;
+    }
+    
+    bool found() const { return mBest != F64_MAX; }
+    
+private:
+    const TriangleMesh &mMesh;
+    const Point3D &mPoint;
+    F64 mBest;
+    
+public:
+    U32 triangle;
+};
+
+U32 TriangleMesh::findTriangle(const Point3D &point) const
+{
+    F64 tolerance = EPSILON * (1.0 + max(fabs(point.x), max(fabs(point.y), fabs(point.z))));
+    Point3D extent(tolerance, tolerance, tolerance);
+    PointVisitor visitor(*this, point);
+    
+    mBVH.traverse(Box3D(point - extent, point + extent), visitor);
+    
+    // Points off the mesh are matched against all of it
+    if (!visitor.found())
+        visitor(0, mTriangles.getCount());
+    return visitor.triangle;
+}
+
+Point3D TriangleMesh::getTriangleNormal(U32 triangle) const
+{
+    Point3D p0 = mTriangles.getVertex(triangle, 0);
+    Point3D normal;
+    
+    cross(mTriangles.getVertex(triangle, 1) - p0, mTriangles.getVertex(triangle, 2) - p0, &normal);
+    normal.normalize();
+    return normal;
+}
+
+Point3D TriangleMesh::getNormal(const Point3D &point) const
+{
+    if (mTriangles.getCount() == 0)
+        return Point3D(0.0, 0.0, 1.0);
+    return getTriangleNormal(findTriangle(point));
+}
+
+Point3D TriangleMesh::getPrimitiveNormal(const Point3D &point, U32 primitive) const
+{
+    if (primitive >= mTriangles.getCount())
+        return getNormal(point);
+    return getTriangleNormal(primitive);
+}
+
+bool TriangleMesh::getExtent(Box3D &box) const
+{
+    box = mBounds;
+    return true;
+}
+
+PointUV TriangleMesh::getUV(const Point3D &point, const Point3D &normal) const
+{
+    if (mTexturePoly)
+        return mTexturePoly->getUV(point, normal);
+    return PointUV();
+}
+
+// The frame perturbs the normal with its own copy of the bump map
+void TriangleMesh::setBumpMap(BumpMap *bumpMap)
+{
+    Parent::setBumpMap(bumpMap);
+    if (mTexturePoly)
+        mTexturePoly->setBumpMap(bumpMap);
+}
+
+void TriangleMesh::perturbNormal(Point3D &normal, const U32 i, const U32 j) const
+{
+    if (mTexturePoly)
+        mTexturePoly->perturbNormal(normal, i, j);
+}
+
+void TriangleMesh::transform(const MatrixD &m)
+{
+    Parent::transform(m);
+    
+    for (std::vector<Point3D>::iterator walk = mVertices.begin(); walk != mVertices.end(); walk++)
+        m.mul(*walk);
+    if (mTexturePoly)
+        mTexturePoly->transform(m);
+    
+    if (mTriangles.getCount())
+        initialize();
+}
+
+void TriangleMesh::transformUV(const MatrixD &m)
+{
+    Parent::transformUV(m);
+    if (mTexturePoly)
+        mTexturePoly->transformUV(m);
+}
+
+void TriangleMesh::write(SceneStream &stream) const
+{
+    Parent::write(stream);
+    stream.write((U32) mVertices.size());
+    if (!mVertices.empty())
+        stream.write((U32) (mVertices.size() * sizeof(Point3D)), &mVertices[0]);
+    stream.write((U32) mIndices.size());
+    if (!mIndices.empty())
+        stream.write((U32) (mIndices.size() * sizeof(U32)), &mIndices[0]);
+    
+    stream.write(mTexturePoly != NULL);
+    if (mTexturePoly)
+        mTexturePoly->write(stream);
+}
+
+bool TriangleMesh::read(SceneStream &stream)
+{
+    U32 count = 0;
+    bool hasTexturePoly = false;
+    
+    Parent::read(stream);
+    if (!stream.read(&count) || U64(count) * sizeof(Point3D) > stream.getRemaining())
+    {
+        stream.fail();
+        return false;
+    }
+    mVertices.resize(count);
+    if (count)
+        stream.read((U32) (count * sizeof(Point3D)), &mVertices[0]);
+    
+    count = 0;
+    if (!stream.read(&count) || count % 3 != 0 || U64(count) * sizeof(U32) > stream.getRemaining())
+    {
+        stream.fail();
+        return false;
+    }
+    mIndices.resize(count);
+    if (count)
+        stream.read((U32) (count * sizeof(U32)), &mIndices[0]);
+    
+    for (std::vector<U32>::const_iterator walk = mIndices.begin(); walk != mIndices.end(); walk++)
+    {
+        if (*walk >= mVertices.size())
+            stream.fail();
+    }
+    
+    stream.read(&hasTexturePoly);
+    if (hasTexturePoly && stream.isOk())
+    {
+        mTexturePoly = new PolygonD();
+        mTexturePoly->read(stream);
+    }
+    
+    if (!stream.isOk())
+        return false;
+    initialize();
+    return true;
+}
\ No newline at end of file